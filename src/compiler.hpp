@@ -5,14 +5,16 @@
 #include <vector>
 #include <cctype>
 #include <array>
-#include <stack>
 #include <cassert>
 #include <optional>
+#include <algorithm>
 
 // local
 #include "utils.hpp"
 #include "operations.hpp"
+#include "optimizer.hpp"
 #include "tokens.hpp"
+#include "cruntime.hpp"
 
 
 class Lexer
@@ -21,7 +23,8 @@ class Lexer
 
         ErrorHandler& error_handler;
         std::string source;
-        std::vector<Token>* output_ptr;
+        std::pmr::memory_resource* resource;
+        std::pmr::vector<Token>* output_ptr;
 
 
         uint32_t idx;
@@ -31,15 +34,16 @@ class Lexer
 
     public:
 
-        Lexer(std::string src, ErrorHandler& eh): error_handler(eh), source(src)
+        Lexer(std::string src, ErrorHandler& eh, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : error_handler(eh), source(std::move(src)), resource(resource)
         {
             this->source_size = this->source.size();
         }
 
         [[nodiscard]]
-        std::vector<Token> lex()
+        std::pmr::vector<Token> lex()
         {
-            std::vector<Token> output;
+            std::pmr::vector<Token> output {this->resource};
             output.reserve(this->source_size);
             this->output_ptr = &output;
 
@@ -256,12 +260,14 @@ class Parser
 {
     private:
         
-        std::vector<PsrOperation*>* output_ptr = nullptr;
-        const std::vector<Token>& token_input;
+        Operations* output_ptr = nullptr;
+        const std::pmr::vector<Token>& token_input;
         ErrorHandler& error_handler;
-        std::stack<PsrOperation*>* loop_stack;
+        std::pmr::memory_resource* resource;
+        std::pmr::vector<uint32_t>* loop_stack; // '['s abertos, índices em 'output_ptr'
 
         bool ascii_default;
+        uint32_t cell_max;
         uint32_t idx;
         bool has_flush;
 
@@ -269,26 +275,24 @@ class Parser
 
     public:
 
-        uint16_t byte_idx;
-
-        Parser(const std::vector<Token>& ti, ErrorHandler& eh, bool ad)
-        : token_input(ti), error_handler(eh), ascii_default(ad), input_size(ti.size())
+        Parser(const std::pmr::vector<Token>& ti, ErrorHandler& eh, bool ad, uint8_t cell_bits = 8,
+               std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : token_input(ti), error_handler(eh), resource(resource), ascii_default(ad), input_size(ti.size())
         {
-
+            this->cell_max = (cell_bits == 32) ? UINT32_MAX : (1u << cell_bits) - 1;
         }
 
         [[nodiscard]]
-        std::vector<PsrOperation*> parse()
+        Operations parse()
         {
-            std::vector<PsrOperation*> output;
+            Operations output {this->resource};
             output.reserve(this->token_input.size());
             this->output_ptr = &output;
 
-            std::stack<PsrOperation*> loop_stack;
+            std::pmr::vector<uint32_t> loop_stack {this->resource};
             this->loop_stack = &loop_stack;
 
             this->idx = 0;
-            this->byte_idx = 0;
 
             this->find_flush();
             this->process_operations();
@@ -319,10 +323,13 @@ class Parser
             // antes de usar 'currtoken(>0)' ou 'match(..., >0)'
             // visto que o Lexer vai sempre colocar um 'TokenType::lEOF' no final
 
+            Operations& output = *this->output_ptr;
+
             while (this->idx < this->input_size)
             {
 
                 const Token& tkn = this->currtoken();
+                uint32_t init = this->idx;
 
                 switch (tkn.oprt)
                 {
@@ -341,20 +348,20 @@ class Parser
                         TokenType type = tkn.oprt;
 
                         int32_t value = 0;
-                        const Token* end;
+                        uint32_t end;
 
                         do
                         {
                             const Token* itkn = &this->currtoken();
 
                             int32_t ivalue = 1;
-                            end = itkn;
+                            end = this->idx;
 
                             if (this->match(TokenType::NUMBER, 1))
                             {
                                 this->idx++;
                                 const Token& nxt = this->currtoken();
-                                end = &nxt;
+                                end = this->idx;
                                 ivalue = std::stoi(nxt.lexeme);
                             }
 
@@ -368,32 +375,31 @@ class Parser
                         while (this->match(type, 0));
 
 
-                        if (value != 0)
-                        {
+                        if ((uint32_t)std::abs(value) > ((type == TokenType::ADD_MEM) ? this->cell_max : UINT8_MAX))
+                            this->error_handler.add_warning("overflow possibility", tkn.line, tkn.collum);
 
-                            if (value > UINT8_MAX)
-                                this->error_handler.add_warning("overflow possibility", tkn.line, tkn.collum);
+                        // movimentos do ponteiro maiores que um int16 são divididos em vários ADD_MP,
+                        // para a fita crescente (que não dá a volta) o deslocamento precisa ser exato
+                        while (value != 0)
+                        {
+                            int32_t part = value;
+                            if (type == TokenType::ADD_MPTR)
+                                part = std::clamp(value, (int32_t)INT16_MIN, (int32_t)INT16_MAX);
+                            value -= part;
 
-                            Operation* admm;
                             if (type == TokenType::ADD_MEM)
                             {
-                                admm = new AddMem{this->byte_idx, (int16_t)value};
-                                byte_idx += static_cast<AddMem*>(admm)->size;
+                                // com células de 8 e 16 bits a soma dá a volta de qualquer jeito,
+                                // só as de 32 bits precisam do valor inteiro
+                                if (this->cell_max != UINT32_MAX)
+                                    part = (int16_t)part;
+                                output.push(OperationType::ADD_MEM, {init, end}, (uint32_t)part);
+                                value = 0;
                             }
                             else if (type == TokenType::ADD_MPTR)
-                            {
-                                admm = new AddMPTR{this->byte_idx, (int16_t)value};
-                                byte_idx += static_cast<AddMPTR*>(admm)->size;
-                            }
+                                output.push(OperationType::ADD_MPTR, {init, end}, (uint32_t)part);
                             else
                                 panic("unexpected type");
-
-                            PsrOperation* noprt = new PsrOperation{};
-                            noprt->init = &tkn;
-                            noprt->end = end;
-                            noprt->oprt = admm;
-
-                            this->output_ptr->push_back(noprt);
                         }
 
                         // não é necessário incrementar o indexador visto que isso já é feito dentro do loop
@@ -402,115 +408,54 @@ class Parser
 
                     case (TokenType::PRINT):
                     {
-                        uint32_t init_idx = this->output_ptr->size();
+                        uint32_t init_idx = output.size();
                         uint32_t end_idx = init_idx - 1;
 
                         do
                         {
-                            Print* print = new Print{this->byte_idx};
-                            PsrOperation* noprt = new PsrOperation{};
-                            noprt->init = &tkn;
-                            noprt->end = &tkn;
-                            noprt->oprt = print;
-
-                            if (this->ascii_default)
-                                print->ascii = true;
-
-                            this->output_ptr->push_back(noprt);
-                            this->byte_idx += print->size;
+                            output.push(OperationType::PRINT, {this->idx, this->idx}, 0, 0, (this->ascii_default) ? OperationFlags::ASCII : 0);
                             this->idx++;
                             end_idx++;
                         }
                         while (this->match(TokenType::PRINT, 0));
 
                         if (!this->has_flush)
-                        {
-                            Flush* flush = new Flush{this->byte_idx};
-                            PsrOperation* noprt = new PsrOperation{};
-                            noprt->init = this->output_ptr->at(init_idx)->init;
-                            noprt->end = this->output_ptr->at(end_idx)->end;
-                            noprt->oprt = flush;
-
-                            this->output_ptr->push_back(noprt);
-                            this->byte_idx += flush->size;
-                        }
-
-                        if (!this->ascii_default && this->match(TokenType::ASCII, 0))
-                        {
-                            for (uint32_t i = init_idx; i <= end_idx; i++)
-                                static_cast<Print*>(this->output_ptr->at(i)->oprt)->ascii = true;
-                            this->idx++;
-                        }
-
-                        else if (this->ascii_default && this->match(TokenType::NUMERIC, 0))
-                        {
-                            for (uint32_t i = init_idx; i <= end_idx; i++)
-                                static_cast<Print*>(this->output_ptr->at(i)->oprt)->ascii = false;
-                            this->idx++;
-                        }
+                            output.push(OperationType::FLUSH, {output.spans[init_idx].init, output.spans[end_idx].end}, 0, 0, OperationFlags::AUTO);
 
+                        this->process_qualifier(init_idx, end_idx);
                         break;
                     }
 
                     case (TokenType::READ):
                     {
-                        uint32_t init_idx = this->output_ptr->size();
+                        uint32_t init_idx = output.size();
                         uint32_t end_idx = init_idx - 1;
 
                         do
                         {
-                            Read* read = new Read{this->byte_idx};
-                            PsrOperation* noprt = new PsrOperation{};
-                            noprt->init = &tkn;
-                            noprt->end = &tkn;
-                            noprt->oprt = read;
-
-                            if (this->ascii_default)
-                                read->ascii = true;
-
-                            this->output_ptr->push_back(noprt);
-                            this->byte_idx += read->size;
+                            output.push(OperationType::READ, {this->idx, this->idx}, 0, 0, (this->ascii_default) ? OperationFlags::ASCII : 0);
                             this->idx++;
                             end_idx++;
                         }
                         while (this->match(TokenType::READ, 0));
 
-                        if (!this->ascii_default && this->match(TokenType::ASCII, 0))
-                        {
-                            for (uint32_t i = init_idx; i <= end_idx; i++)
-                                static_cast<Read*>(this->output_ptr->at(i)->oprt)->ascii = true;
-                            this->idx++;
-                        }
-
-                        else if (this->ascii_default && this->match(TokenType::NUMERIC, 0))
-                        {
-                            for (uint32_t i = init_idx; i <= end_idx; i++)
-                                static_cast<Read*>(this->output_ptr->at(i)->oprt)->ascii = false;
-                            this->idx++;
-                        }
-
+                        this->process_qualifier(init_idx, end_idx);
                         break;
                     }
 
                     case (TokenType::LOOP_LEFT):
                     {
-                        Loop* loop = new Loop{this->byte_idx, 0, 0};
-                        PsrOperation* noprt = new PsrOperation{};
-                        noprt->init = &tkn;
-                        noprt->end = &tkn;
-                        noprt->oprt = loop;
+                        uint32_t comp_value = 0;
+                        uint32_t end = init;
 
                         if (this->match(TokenType::NUMBER, 1))
                         {
                             this->idx++;
-                            const Token& nxt = this->currtoken();
-                            noprt->end = &nxt;
-                            loop->comp_value = std::stoi(nxt.lexeme);
+                            end = this->idx;
+                            comp_value = std::stoul(this->currtoken().lexeme);
                         }
 
-                        this->loop_stack->push(noprt);
-                        this->output_ptr->push_back(noprt);
-                        this->byte_idx += loop->size;
+                        this->loop_stack->push_back(output.push(OperationType::LOOP, {init, end}, comp_value, 0, OperationFlags::LEFT));
                         this->idx++;
 
                         break;
@@ -527,16 +472,13 @@ class Parser
                             break;
                         }
 
-                        Loop* loop = static_cast<Loop*>(this->loop_stack->top()->oprt)->make_pair(this->byte_idx);
-                        this->loop_stack->pop();
+                        uint32_t left = this->loop_stack->back();
+                        this->loop_stack->pop_back();
 
-                        PsrOperation* noprt = new PsrOperation{};
-                        noprt->init = &tkn;
-                        noprt->end = &tkn;
-                        noprt->oprt = loop;
+                        uint32_t right = output.push(OperationType::LOOP, {init, init}, output.values[left]);
+                        output.links[left] = output.targets[left] = right;
+                        output.links[right] = output.targets[right] = left;
 
-                        this->output_ptr->push_back(noprt);
-                        this->byte_idx += loop->size;
                         this->idx++;
 
                         break;
@@ -544,14 +486,7 @@ class Parser
 
                     case (TokenType::FLUSH):
                     {
-                        Flush* flush = new Flush{this->byte_idx};
-                        PsrOperation* noprt = new PsrOperation{};
-                        noprt->init = &tkn;
-                        noprt->end = &tkn;
-                        noprt->oprt = flush;
-
-                        this->output_ptr->push_back(noprt);
-                        this->byte_idx += flush->size;
+                        output.push(OperationType::FLUSH, {init, init});
                         this->idx++;
 
                         break;
@@ -578,9 +513,9 @@ class Parser
                         
                         while (this->loop_stack->size() > 0)
                         {
-                            PsrOperation* rem = this->loop_stack->top();
-                            this->loop_stack->pop();
-                            this->error_handler.add_error("'[' matchless", rem->init->line, rem->init->collum);
+                            const Token& rem = this->token_input.at(output.spans[this->loop_stack->back()].init);
+                            this->loop_stack->pop_back();
+                            this->error_handler.add_error("'[' matchless", rem.line, rem.collum);
                         }
 
                         this->idx++;
@@ -589,6 +524,27 @@ class Parser
             }
         }
 
+        // 'a' ou 'n' depois de uma sequência de PRINTs ou READs, que
+        // ocupam as posições de 'init_idx' a 'end_idx' da saída
+        void process_qualifier(uint32_t init_idx, uint32_t end_idx)
+        {
+            std::pmr::vector<uint8_t>& flags = this->output_ptr->flags;
+
+            if (!this->ascii_default && this->match(TokenType::ASCII, 0))
+            {
+                for (uint32_t i = init_idx; i <= end_idx; i++)
+                    flags[i] |= OperationFlags::ASCII;
+                this->idx++;
+            }
+
+            else if (this->ascii_default && this->match(TokenType::NUMERIC, 0))
+            {
+                for (uint32_t i = init_idx; i <= end_idx; i++)
+                    flags[i] &= ~OperationFlags::ASCII;
+                this->idx++;
+            }
+        }
+
 
         // #################################################
         // #                                               #
@@ -615,15 +571,19 @@ struct Program
 {
     uint8_t* program;
     uint32_t size;
+    uint8_t flags; // 'BinaryFlags'
+    std::vector<uint8_t> snapshot {}; // com 'BinaryFlags::SNAPSHOT', gravado entre as flags e o programa
+    uint32_t dead_bytes = 0;          // 'Optimizer::dead_bytes'
 };
 
-std::optional<Program> compile(std::string source_code, bool insert_end, bool ascii_default)
+// análise e otimização, comum a todos os backends, toda a memória vem de 'arena'
+std::optional<Operations> front_end(std::string source_code, bool ascii_default, uint8_t cell_bits, const OptimizerOptions& options, uint32_t& dead_bytes, Arena& arena)
 {
     bool error = false;
     ErrorHandler eh {error};
 
-    Lexer lex {source_code, eh};
-    std::vector<Token> lres = lex.lex();
+    Lexer lex {std::move(source_code), eh, arena.resource()};
+    std::pmr::vector<Token> lres = lex.lex();
 
     if (error)
     {
@@ -631,8 +591,8 @@ std::optional<Program> compile(std::string source_code, bool insert_end, bool as
         return {};
     }
 
-    Parser par = Parser{lres, eh, ascii_default};
-    std::vector<PsrOperation*> pres = par.parse();
+    Parser par = Parser{lres, eh, ascii_default, cell_bits, arena.resource()};
+    Operations pres = par.parse();
 
     if (error)
     {
@@ -641,23 +601,112 @@ std::optional<Program> compile(std::string source_code, bool insert_end, bool as
     }
     // else
     // {
-    //     for (PsrOperation* oprt: pres)
-    //         std::cout << oprt->oprt->repr() << std::endl;
+    //     for (uint32_t i = 0; i < pres.size(); i++)
+    //         std::cout << pres.repr(i) << std::endl;
     // }
 
-    uint8_t* program = new uint8_t[par.byte_idx + 1];
+    auto optimize = [&](auto&& optimizer)
+    {
+        optimizer.optimize();
+        dead_bytes = optimizer.dead_bytes;
+    };
+
+    if (cell_bits == 32)
+        optimize(Optimizer<uint32_t>{pres, options});
+    else if (cell_bits == 16)
+        optimize(Optimizer<uint16_t>{pres, options});
+    else
+        optimize(Optimizer<uint8_t>{pres, options});
+
+    return {std::move(pres)};
+}
+
+std::optional<Program> compile(std::string source_code, bool insert_end, bool ascii_default, uint8_t cell_bits = 8, const OptimizerOptions& options = OptimizerOptions::level(3))
+{
+    // liberado de uma vez no retorno, depois de 'opres'
+    Arena arena;
+
+    uint32_t dead_bytes = 0;
+    std::optional<Operations> opres = front_end(std::move(source_code), ascii_default, cell_bits, options, dead_bytes, arena);
+    if (!opres.has_value())
+        return {};
+
+    const Operations& pres = opres.value();
+
+    uint8_t flags = 0;
+    Encoding enc;
+
+    if (cell_bits == 32)
+    {
+        flags |= BinaryFlags::CELL_32;
+        enc.cell_bytes = 4;
+    }
+    else if (cell_bits == 16)
+    {
+        flags |= BinaryFlags::CELL_16;
+        enc.cell_bytes = 2;
+    }
+
+    // os saltos só passam a ter 32 bits quando o programa não cabe em 16
+    std::pmr::vector<uint32_t> positions {arena.resource()};
+    uint32_t program_size = layout_program(pres, enc, positions);
+    if (program_size + 1 > UINT16_MAX)
+    {
+        flags |= BinaryFlags::WIDE_JUMPS;
+        enc.wide_jumps = true;
+        program_size = layout_program(pres, enc, positions);
+    }
+
+    uint8_t* program = new uint8_t[program_size + 1];
     uint32_t idx = 0;
 
-    for (PsrOperation* oprt: pres)
-        oprt->oprt->serialize(program, idx);
+    for (uint32_t i = 0; i < pres.size(); i++)
+        pres.serialize(i, program, idx, enc, positions);
 
     if (insert_end)
         write_to_program(program, idx, (uint8_t)InstructionSet::END);
 
-    for (PsrOperation* oprt: pres)
-        delete oprt;
+    return {Program{program, program_size + 1, flags, {}, dead_bytes}};
+}
+
+// gera um programa C equivalente, com a fita em um array estático
+// e a E/S feita pelas funções de 'c_runtime'
+std::optional<std::string> compile_to_c(std::string source_code, bool ascii_default, uint8_t cell_bits = 8, const OptimizerOptions& options = OptimizerOptions::level(3))
+{
+    // liberado de uma vez no retorno, depois de 'opres'
+    Arena arena;
+
+    uint32_t dead_bytes = 0;
+    std::optional<Operations> opres = front_end(std::move(source_code), ascii_default, cell_bits, options, dead_bytes, arena);
+    if (!opres.has_value())
+        return {};
+
+    const Operations& pres = opres.value();
+
+    std::string out {"#include <stdint.h>\n\ntypedef uint"};
+    out.append(std::to_string(cell_bits));
+    out.append("_t cell;\n\n");
+    out.append(c_runtime);
+    out.append("\nint main(void)\n{\n");
+
+    uint32_t depth = 1;
+    for (uint32_t i = 0; i < pres.size(); i++)
+    {
+        std::string line = pres.to_c(i);
+        if (line == "}")
+            depth--;
+
+        out.append(depth * 4, ' ');
+        out.append(line);
+        out.push_back('\n');
+
+        if (line.back() == '{')
+            depth++;
+    }
+
+    out.append("\n    return 0;\n}\n");
 
-    return {Program{program, (uint32_t)(par.byte_idx + 1)}};
+    return {out};
 }
 
 void create_binary(const Program& prog, const char* const path, bool has_end)
@@ -668,7 +717,8 @@ void create_binary(const Program& prog, const char* const path, bool has_end)
         panic("error creating file");
 
     file.write("brfk", 4);
-    file.put(0x00);
+    file.put(prog.flags);
+    file.write((const char*)prog.snapshot.data(), prog.snapshot.size());
     file.write((const char*)prog.program, prog.size);
     if (!has_end)
         file.put((char)InstructionSet::END);
@@ -676,6 +726,17 @@ void create_binary(const Program& prog, const char* const path, bool has_end)
     file.close();
 }
 
+void create_c_source(const std::string& source, const char* const path)
+{
+    std::ofstream file {path, std::ios::out};
+
+    if (file.bad() || !file.is_open())
+        panic("error creating file");
+
+    file << source;
+    file.close();
+}
+
 
 
 #endif
\ No newline at end of file
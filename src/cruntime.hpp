@@ -0,0 +1,106 @@
+#ifndef BRFK_CRUNTIME
+#define BRFK_CRUNTIME
+
+
+// runtime copiado para o início dos programas gerados por 'build --emit=c',
+// vem depois da definição de 'cell' e segue a VM: fita de 65536 células
+// com 'mp' dando a volta, entrada lida palavra por palavra e saída
+// acumulada até um FLUSH, descartada se não houver um
+static const char* const c_runtime = R"(#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+static cell mem[65536];
+static uint16_t mp;
+
+static char brfk_input[4096];
+static size_t brfk_input_pos, brfk_input_len;
+
+static void brfk_panic(const char* message)
+{
+    fflush(stdout);
+    printf("\033[91m[PANIC]: %s\033[39m\n", message);
+    exit(1);
+}
+
+static void brfk_fill(void)
+{
+    while (brfk_input_pos >= brfk_input_len)
+    {
+        if (scanf("%4095s", brfk_input) != 1)
+            brfk_panic("end of input");
+
+        brfk_input_pos = 0;
+        brfk_input_len = strlen(brfk_input);
+    }
+}
+
+static inline cell brfk_read_char(void)
+{
+    brfk_fill();
+    return (unsigned char)brfk_input[brfk_input_pos++];
+}
+
+static inline cell brfk_read_num(void)
+{
+    unsigned long value = 0;
+
+    brfk_fill();
+    if (!isdigit((unsigned char)brfk_input[brfk_input_pos]))
+        brfk_panic("value received by READ_NUM is not a number");
+
+    while (isdigit((unsigned char)brfk_input[brfk_input_pos]))
+        value = value * 10 + (brfk_input[brfk_input_pos++] - '0');
+
+    return (cell)value;
+}
+
+// como o 'bstdout' da VM: a saída só é escrita por um FLUSH,
+// o que sobra no fim do programa ou num panic é descartado
+static char* brfk_output;
+static size_t brfk_output_len, brfk_output_cap;
+
+static void brfk_reserve(size_t length)
+{
+    if (brfk_output_len + length <= brfk_output_cap)
+        return;
+
+    while (brfk_output_len + length > brfk_output_cap)
+        brfk_output_cap = (brfk_output_cap == 0) ? 4096 : brfk_output_cap * 2;
+
+    brfk_output = (char*)realloc(brfk_output, brfk_output_cap);
+    if (brfk_output == NULL)
+        brfk_panic("out of memory");
+}
+
+static inline void brfk_print_string(const char* text, size_t length)
+{
+    brfk_reserve(length);
+    memcpy(brfk_output + brfk_output_len, text, length);
+    brfk_output_len += length;
+}
+
+static inline void brfk_print_num(cell value)
+{
+    char digits[24];
+    int length = snprintf(digits, sizeof(digits), "%lu", (unsigned long)value);
+    brfk_print_string(digits, (size_t)length);
+}
+
+static inline void brfk_print_ascii(cell value)
+{
+    brfk_reserve(1);
+    brfk_output[brfk_output_len++] = (char)value;
+}
+
+static inline void brfk_flush(void)
+{
+    fwrite(brfk_output, 1, brfk_output_len, stdout);
+    fflush(stdout);
+    brfk_output_len = 0;
+}
+)";
+
+
+#endif
@@ -0,0 +1,390 @@
+#ifndef BRFK_JIT_ASM
+#define BRFK_JIT_ASM
+
+// built-in
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// o JIT só executa código em x86-64 com mmap/mprotect, nos outros
+// sistemas a VM sempre interpreta ('Assembler' funciona em qualquer um)
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))
+    #include <sys/mman.h>
+    #include <unistd.h>
+    #define BRFK_JIT
+#endif
+
+
+namespace x64
+{
+    enum Reg : uint8_t
+    {
+        RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+        R8, R9, R10, R11, R12, R13, R14, R15
+    };
+
+    enum Cond : uint8_t
+    {
+        B  = 0x2,
+        AE = 0x3,
+        EQ = 0x4,
+        NE = 0x5,
+        BE = 0x6,
+        A  = 0x7,
+        LE = 0xE
+    };
+
+    // operando de memória [base + index * scale], sem índice com 'index' RSP
+    struct Mem
+    {
+        Reg base;
+        Reg index;
+        uint8_t scale;
+    };
+}
+
+
+// emite apenas as instruções que a VM usa, 'width' é o tamanho do
+// operando em bytes (1, 2, 4 ou 8)
+class Assembler
+{
+    public:
+
+        std::vector<uint8_t> code;
+
+        uint32_t size() const
+        {
+            return this->code.size();
+        }
+
+        void push(x64::Reg reg)
+        {
+            if (reg & 8)
+                this->byte(0x41);
+            this->byte(0x50 | (reg & 7));
+        }
+
+        void pop(x64::Reg reg)
+        {
+            if (reg & 8)
+                this->byte(0x41);
+            this->byte(0x58 | (reg & 7));
+        }
+
+        void ret()
+        {
+            this->byte(0xC3);
+        }
+
+        // mov dst, src
+        void mov(x64::Reg dst, x64::Reg src, uint8_t width)
+        {
+            this->prefix(width, src, 0, dst);
+            this->byte((width == 1) ? 0x88 : 0x89);
+            this->modrm(src, dst);
+        }
+
+        // mov dst, imm (sinal estendido com 'width' 8)
+        void mov(x64::Reg dst, int32_t imm, uint8_t width)
+        {
+            this->prefix(width, 0, 0, dst);
+            this->byte((width == 1) ? 0xC6 : 0xC7);
+            this->modrm(0, dst);
+            this->imm(imm, width);
+        }
+
+        void mov(x64::Mem dst, int32_t imm, uint8_t width)
+        {
+            this->prefix(width, 0, dst.index, dst.base);
+            this->byte((width == 1) ? 0xC6 : 0xC7);
+            this->modrm(0, dst);
+            this->imm(imm, width);
+        }
+
+        void mov(x64::Mem dst, x64::Reg src, uint8_t width)
+        {
+            this->prefix(width, src, dst.index, dst.base);
+            this->byte((width == 1) ? 0x88 : 0x89);
+            this->modrm(src, dst);
+        }
+
+        void mov(x64::Reg dst, x64::Mem src, uint8_t width)
+        {
+            this->prefix(width, dst, src.index, src.base);
+            this->byte((width == 1) ? 0x8A : 0x8B);
+            this->modrm(dst, src);
+        }
+
+        void mov64(x64::Reg dst, uint64_t imm)
+        {
+            this->byte(0x48 | ((dst & 8) ? 1 : 0));
+            this->byte(0xB8 | (dst & 7));
+            for (uint8_t i = 0; i < 8; i++)
+                this->byte(imm >> (i * 8));
+        }
+
+        // carrega 'width' bytes em 'dst' estendendo com zeros até 32 bits
+        void movzx(x64::Reg dst, x64::Mem src, uint8_t width)
+        {
+            this->prefix(4, dst, src.index, src.base);
+            if (width == 4)
+                this->byte(0x8B);
+            else
+            {
+                this->byte(0x0F);
+                this->byte((width == 1) ? 0xB6 : 0xB7);
+            }
+            this->modrm(dst, src);
+        }
+
+        void movzx(x64::Reg dst, x64::Reg src, uint8_t width)
+        {
+            if (width == 4)
+            {
+                this->mov(dst, src, 4);
+                return;
+            }
+
+            this->prefix(4, dst, 0, src);
+            this->byte(0x0F);
+            this->byte((width == 1) ? 0xB6 : 0xB7);
+            this->modrm(dst, src);
+        }
+
+        // lea dst, [base + disp]
+        void lea(x64::Reg dst, x64::Reg base, int32_t disp, uint8_t width)
+        {
+            this->prefix(width, dst, 0, base);
+            this->byte(0x8D);
+            this->byte(0x80 | ((dst & 7) << 3) | (base & 7));
+            if ((base & 7) == x64::RSP)
+                this->byte(0x24);
+            this->imm(disp, 4);
+        }
+
+        void add(x64::Reg dst, int32_t imm, uint8_t width)
+        {
+            this->alu_imm(0, dst, imm, width);
+        }
+
+        void add(x64::Mem dst, int32_t imm, uint8_t width)
+        {
+            this->prefix(width, 0, dst.index, dst.base);
+            this->byte((width == 1) ? 0x80 : 0x81);
+            this->modrm(0, dst);
+            this->imm(imm, (width == 8) ? 4 : width);
+        }
+
+        void add(x64::Reg dst, x64::Reg src, uint8_t width)
+        {
+            this->prefix(width, src, 0, dst, true);
+            this->byte((width == 1) ? 0x00 : 0x01);
+            this->modrm(src, dst);
+        }
+
+        void add(x64::Mem dst, x64::Reg src, uint8_t width)
+        {
+            this->prefix(width, src, dst.index, dst.base, true);
+            this->byte((width == 1) ? 0x00 : 0x01);
+            this->modrm(src, dst);
+        }
+
+        void sub(x64::Reg dst, x64::Reg src, uint8_t width)
+        {
+            this->prefix(width, src, 0, dst, true);
+            this->byte((width == 1) ? 0x28 : 0x29);
+            this->modrm(src, dst);
+        }
+
+        void xor_(x64::Reg dst, x64::Reg src, uint8_t width)
+        {
+            this->prefix(width, src, 0, dst, true);
+            this->byte((width == 1) ? 0x30 : 0x31);
+            this->modrm(src, dst);
+        }
+
+        void cmp(x64::Reg dst, int32_t imm, uint8_t width)
+        {
+            this->alu_imm(7, dst, imm, width);
+        }
+
+        void cmp(x64::Reg dst, x64::Reg src, uint8_t width)
+        {
+            this->prefix(width, src, 0, dst, true);
+            this->byte((width == 1) ? 0x38 : 0x39);
+            this->modrm(src, dst);
+        }
+
+        void test(x64::Reg dst, x64::Reg src, uint8_t width)
+        {
+            this->prefix(width, src, 0, dst, true);
+            this->byte((width == 1) ? 0x84 : 0x85);
+            this->modrm(src, dst);
+        }
+
+        // imul dst, src, imm (32 bits)
+        void imul(x64::Reg dst, x64::Reg src, int32_t imm)
+        {
+            this->prefix(4, dst, 0, src);
+            this->byte(0x69);
+            this->modrm(dst, src);
+            this->imm(imm, 4);
+        }
+
+        // divisão sem sinal de edx:eax (ou rdx:rax) por 'src'
+        void div(x64::Reg src, uint8_t width)
+        {
+            this->prefix(width, 0, 0, src);
+            this->byte(0xF7);
+            this->modrm(6, src);
+        }
+
+        void call(x64::Reg reg)
+        {
+            this->prefix(4, 0, 0, reg);
+            this->byte(0xFF);
+            this->modrm(2, reg);
+        }
+
+        void syscall()
+        {
+            this->byte(0x0F);
+            this->byte(0x05);
+        }
+
+        // saltos com deslocamento de 32 bits, retornam a posição
+        // do deslocamento para ser preenchido por 'patch'
+        uint32_t jmp()
+        {
+            this->byte(0xE9);
+            this->imm(0, 4);
+            return this->size() - 4;
+        }
+
+        uint32_t call()
+        {
+            this->byte(0xE8);
+            this->imm(0, 4);
+            return this->size() - 4;
+        }
+
+        uint32_t jcc(x64::Cond cond)
+        {
+            this->byte(0x0F);
+            this->byte(0x80 | cond);
+            this->imm(0, 4);
+            return this->size() - 4;
+        }
+
+        void patch(uint32_t at, uint32_t target)
+        {
+            int32_t rel = target - (at + 4);
+            for (uint8_t i = 0; i < 4; i++)
+                this->code[at + i] = rel >> (i * 8);
+        }
+
+    private:
+
+        void byte(uint8_t value)
+        {
+            this->code.push_back(value);
+        }
+
+        void imm(int32_t value, uint8_t width)
+        {
+            for (uint8_t i = 0; i < width && i < 4; i++)
+                this->byte(value >> (i * 8));
+        }
+
+        // prefixo 0x66 para 16 bits e REX quando algum registrador é r8-r15,
+        // quando o operando tem 64 bits ou, com 'byte_regs', quando um registrador
+        // de 8 bits seria lido como ah/ch/dh/bh sem ele
+        void prefix(uint8_t width, uint8_t reg, uint8_t index, uint8_t base, bool byte_regs = false)
+        {
+            if (width == 2)
+                this->byte(0x66);
+
+            uint8_t rex = 0x40 | ((width == 8) ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((index & 8) ? 2 : 0) | ((base & 8) ? 1 : 0);
+            if (rex != 0x40 || (byte_regs && width == 1 && ((reg & 7) >= 4 || (base & 7) >= 4)))
+                this->byte(rex);
+        }
+
+        void modrm(uint8_t reg, x64::Reg rm)
+        {
+            this->byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+        }
+
+        // a base nunca é rbp/r13, que exigiriam deslocamento
+        void modrm(uint8_t reg, x64::Mem mem)
+        {
+            uint8_t scale = (mem.scale == 8) ? 3 : (mem.scale == 4) ? 2 : (mem.scale == 2) ? 1 : 0;
+            this->byte(((reg & 7) << 3) | 0x04);
+            this->byte((scale << 6) | ((mem.index & 7) << 3) | (mem.base & 7));
+        }
+
+        void alu_imm(uint8_t ext, x64::Reg dst, int32_t imm, uint8_t width)
+        {
+            this->prefix(width, 0, 0, dst);
+            this->byte((width == 1) ? 0x80 : 0x81);
+            this->modrm(ext, dst);
+            this->imm(imm, (width == 8) ? 4 : width);
+        }
+};
+
+
+#ifdef BRFK_JIT
+// código gerado pelo JIT, nunca é gravável e executável ao mesmo tempo (W^X):
+// é copiado com PROT_READ | PROT_WRITE e só então passa a PROT_READ | PROT_EXEC
+class ExecutableMemory
+{
+    public:
+
+        void* data = nullptr;
+        size_t size = 0;
+
+        ExecutableMemory() = default;
+        ExecutableMemory(const ExecutableMemory&) = delete;
+        ExecutableMemory& operator=(const ExecutableMemory&) = delete;
+
+        ~ExecutableMemory()
+        {
+            this->release();
+        }
+
+        bool load(const std::vector<uint8_t>& code)
+        {
+            this->release();
+
+            size_t page = sysconf(_SC_PAGESIZE);
+            size_t size = (code.size() + page - 1) / page * page;
+
+            void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (data == MAP_FAILED)
+                return false;
+
+            memcpy(data, code.data(), code.size());
+            if (mprotect(data, size, PROT_READ | PROT_EXEC) != 0)
+            {
+                munmap(data, size);
+                return false;
+            }
+
+            this->data = data;
+            this->size = size;
+            return true;
+        }
+
+        void release()
+        {
+            if (this->data == nullptr)
+                return;
+
+            munmap(this->data, this->size);
+            this->data = nullptr;
+            this->size = 0;
+        }
+};
+#endif
+
+
+#endif
@@ -9,13 +9,69 @@
 #include "vm.hpp"
 #include "operations.hpp"
 #include "compiler.hpp"
+#include "native.hpp"
 
 // extern
 #include "lib/CLI11.hpp"
 
 
 
-void comp(const std::string& file_path, const std::string& output_path, bool ascii_default)
+template <typename Cell>
+void execute(uint8_t* program, uint32_t size, uint8_t flags, DispatchMode dispatch, TapeMode tape)
+{
+    VirtualMachine<Cell> vm {tape};
+
+    // o snapshot fica entre as flags e o programa
+    uint32_t snapshot_size = (flags & BinaryFlags::SNAPSHOT) ? vm.restore(program, size) : 0;
+
+    vm.flags = flags;
+    vm.program_size = size - snapshot_size;
+    vm.program = program + snapshot_size;
+
+    vm.run(dispatch);
+}
+
+// escolhe a largura das células da VM conforme as flags do binário
+void execute(uint8_t* program, uint32_t size, uint8_t flags, DispatchMode dispatch, TapeMode tape)
+{
+    if ((flags & BinaryFlags::CELL_16) && (flags & BinaryFlags::CELL_32))
+        panic("binary with more than one cell width");
+
+    if (flags & BinaryFlags::CELL_32)
+        execute<uint32_t>(program, size, flags, dispatch, tape);
+    else if (flags & BinaryFlags::CELL_16)
+        execute<uint16_t>(program, size, flags, dispatch, tape);
+    else
+        execute<uint8_t>(program, size, flags, dispatch, tape);
+}
+
+template <typename Cell>
+void pre_execute(Program& prog, uint64_t budget)
+{
+    VirtualMachine<Cell> vm;
+
+    vm.flags = prog.flags;
+    vm.program_size = prog.size;
+    vm.program = prog.program;
+
+    vm.pre_execute(budget);
+
+    prog.snapshot = vm.snapshot();
+    prog.flags |= BinaryFlags::SNAPSHOT;
+}
+
+// executa o programa até a primeira leitura e guarda o estado no binário
+void pre_execute(Program& prog, uint64_t budget)
+{
+    if (prog.flags & BinaryFlags::CELL_32)
+        pre_execute<uint32_t>(prog, budget);
+    else if (prog.flags & BinaryFlags::CELL_16)
+        pre_execute<uint16_t>(prog, budget);
+    else
+        pre_execute<uint8_t>(prog, budget);
+}
+
+void comp(const std::string& file_path, const std::string& output_path, bool ascii_default, uint8_t cell_bits, const OptimizerOptions& options, const std::string& emit, bool native, std::optional<uint64_t> pre_execute_budget)
 {
     std::ifstream file;
 
@@ -35,19 +91,45 @@ void comp(const std::string& file_path, const std::string& output_path, bool asc
     uint32_t file_size = file.tellg();
     file.seekg(0, file.beg);
 
-    char* csfile = new char[file_size + 1];
-    file.read(csfile, file_size);
-    csfile[file_size] = 0;
-    std::string sfile {std::move(csfile)};
+    std::string sfile(file_size, '\0');
+    file.read(sfile.data(), file_size);
 
     file.close();
 
-    std::optional<Program> prog = compile(sfile, true, ascii_default);
-    if (prog.has_value())
+    if (emit == "c")
+    {
+        std::optional<std::string> csource = compile_to_c(sfile, ascii_default, cell_bits, options);
+        if (csource.has_value())
+            create_c_source(csource.value(), output_path.data());
+        return;
+    }
+
+    std::optional<Program> prog = compile(sfile, true, ascii_default, cell_bits, options);
+    if (!prog.has_value())
+        return;
+
+    if (prog.value().dead_bytes != 0)
+    {
+        std::cout << Color::get_color(Color::FG_LIGHT_MAGENTA)
+                  << "dead code removed: "
+                  << prog.value().dead_bytes
+                  << " bytes"
+                  << Color::get_color(Color::FG_DEFAULT)
+                  << std::endl;
+    }
+
+    if (pre_execute_budget.has_value())
+        pre_execute(prog.value(), pre_execute_budget.value());
+
+    if (native)
+        create_native(prog.value(), output_path.data());
+    else
         create_binary(prog.value(), output_path.data(), true);
+
+    delete[] prog.value().program;
 }
 
-void run(const std::string& file_path, bool scompile, bool ascii_default)
+void run(const std::string& file_path, bool scompile, bool ascii_default, uint8_t cell_bits, const OptimizerOptions& options, DispatchMode dispatch, TapeMode tape)
 {
     std::ifstream file;
 
@@ -67,22 +149,23 @@ void run(const std::string& file_path, bool scompile, bool ascii_default)
     uint32_t file_size = file.tellg();
     file.seekg(0, file.beg);
 
-    char buffer[5];
-    file.read(buffer, 4);
+    // assinatura "brfk" seguida do byte de flags ('BinaryFlags')
+    char header[5] = {0};
+    file.read(header, 5);
+    file.clear();
+
+    uint8_t flags = header[4];
 
-    if (strcmp("brfk", buffer) == 0 && file.peek() == 0x00)
+    if (file_size >= 5 && memcmp("brfk", header, 4) == 0 && (flags & ~BinaryFlags::ALL) == 0)
     {
-        file.seekg(1, file.cur);
         file_size -= 5;
 
-        VirtualMachine vm;
-
-        vm.program_size = file_size;
-        vm.program = new uint8_t[file_size];
-        file.read((char*)vm.program, file_size);
+        uint8_t* program = new uint8_t[file_size];
+        file.read((char*)program, file_size);
         file.close();
 
-        vm.run();
+        execute(program, file_size, flags, dispatch, tape);
+        delete[] program;
     }
     else if (scompile)
     {
@@ -93,22 +176,16 @@ void run(const std::string& file_path, bool scompile, bool ascii_default)
 
         file.seekg(0, file.beg);
 
-        char* csfile = new char[file_size + 1];
-        file.read(csfile, file_size);
-        csfile[file_size] = 0;
+        std::string sfile(file_size, '\0');
+        file.read(sfile.data(), file_size);
         file.close();
 
-        std::string sfile {std::move(csfile)};
-        std::optional<Program> oprog = compile(sfile, true, ascii_default);
+        std::optional<Program> oprog = compile(sfile, true, ascii_default, cell_bits, options);
         if (oprog.has_value())
         {
             Program prog = oprog.value();
-            VirtualMachine vm;
-
-            vm.program_size = prog.size;
-            vm.program = prog.program;
-
-            vm.run();
+            execute(prog.program, prog.size, prog.flags, dispatch, tape);
+            delete[] prog.program;
         }
     }
     else
@@ -125,8 +202,37 @@ int main(int argc, char** argv)
 
     bool ascii_default = false;
     bool scompile = false;
+    bool jit = false;
+    bool tiered = false;
     std::string file_path;
     std::string output_path;
+    std::string dispatch = "threaded";
+    std::string tape = "fixed";
+    uint8_t cell_bits = 8;
+    uint32_t unroll_limit = 64;
+    uint8_t opt_level = 3;
+    std::vector<std::string> pass_flags;
+    std::string emit = "bytecode";
+    bool native = false;
+    bool pre_exec = false;
+    uint64_t pre_execute_steps = 100000000;
+
+    // "-f<passo>" liga e "-fno-<passo>" desliga um passo do otimizador
+    std::vector<std::string> pass_flag_names;
+    for (const char* name : pass_names)
+    {
+        pass_flag_names.push_back(name);
+        pass_flag_names.push_back(std::string("no-") + name);
+    }
+
+    // o nível define os passos e os "-f" são aplicados em ordem por cima dele
+    auto optimizer_options = [&]()
+    {
+        OptimizerOptions options = OptimizerOptions::level(opt_level, unroll_limit);
+        for (const std::string& flag : pass_flags)
+            options.toggle(flag);
+        return options;
+    };
 
     CLI::App app {"Turbo Brainfuck"};
     app.require_subcommand(1, 1);
@@ -136,13 +242,43 @@ int main(int argc, char** argv)
     sub_run->add_flag("-a, --ascii_default", ascii_default, "if a compilation is required, input and output are, by default, in ASCII mode, without the need to place the qualifier 'a'");
     sub_run->add_flag("-c, --compile", scompile, "tries to compile the file if it is not a valid brainfuck binary");
 
-    sub_run->callback([&](){run(file_path, scompile, ascii_default);});
+    sub_run->add_option("--dispatch", dispatch, "instruction dispatch strategy of the virtual machine")->check(CLI::IsMember({"switch", "threaded"}))->default_val("threaded");
+
+    CLI::Option* jit_flag = sub_run->add_flag("--jit", jit, "translates the program to x86-64 machine code instead of interpreting it, falls back to the interpreter when that is not possible");
+    sub_run->add_flag("--tiered", tiered, "interprets the program and translates loops to x86-64 machine code once they become hot")->excludes(jit_flag);
+
+    sub_run->add_option("--tape", tape, "'fixed': 65536 cells with a wrapping pointer, 'growable': grows on demand in both directions from the middle")->check(CLI::IsMember({"fixed", "growable"}))->default_val("fixed");
+
+    sub_run->add_option("--cell-bits", cell_bits, "if a compilation is required, width of the memory cells in bits")->check(CLI::IsMember({8, 16, 32}))->default_val(8);
+    sub_run->add_option("--unroll-limit", unroll_limit, "if a compilation is required, maximum number of operations produced when unrolling a loop with a known trip count, 0 disables unrolling")->default_val(64);
+    sub_run->add_option("-O", opt_level, "if a compilation is required, optimization level: 0 runs no pass, 1 only the local rewrites, 2 also the dataflow passes, 3 also loop unrolling")->check(CLI::Range(0, 3))->default_val(3);
+    sub_run->add_option("-f", pass_flags, "if a compilation is required, enables ('-f<pass>') or disables ('-fno-<pass>') a single optimizer pass on top of the level")->check(CLI::IsMember(pass_flag_names))
+        ->expected(1)->allow_extra_args(false)->multi_option_policy(CLI::MultiOptionPolicy::TakeAll);
+
+    sub_run->callback([&](){
+        run(file_path, scompile, ascii_default, cell_bits, optimizer_options(),
+            (jit) ? DispatchMode::JIT : (tiered) ? DispatchMode::TIERED : (dispatch == "switch") ? DispatchMode::SWITCH : DispatchMode::THREADED,
+            (tape == "growable") ? TapeMode::GROWABLE : TapeMode::FIXED);
+    });
 
     CLI::App* sub_comp = app.add_subcommand("build","compiles the code file and produces a binary that can be run with the 'run' command");
     sub_comp->add_option("file", file_path, "file to be compiled")->required(true);
     sub_comp->add_option("-o, --output", output_path, "path where the binary will be placed")->default_val("a.out");
     sub_comp->add_flag("-a, --ascii_default", ascii_default, "input and output are by default in ASCII mode, without the need to place the qualifier 'a'");
-    sub_comp->callback([&](){comp(file_path, output_path, ascii_default);});
+    sub_comp->add_option("--cell-bits", cell_bits, "width of the memory cells in bits, stored in the binary")->check(CLI::IsMember({8, 16, 32}))->default_val(8);
+    sub_comp->add_option("--unroll-limit", unroll_limit, "maximum number of operations produced when unrolling a loop with a known trip count, 0 disables unrolling")->default_val(64);
+    sub_comp->add_option("-O", opt_level, "optimization level: 0 runs no pass, 1 only the local rewrites, 2 also the dataflow passes, 3 also loop unrolling")->check(CLI::Range(0, 3))->default_val(3);
+    sub_comp->add_option("-f", pass_flags, "enables ('-f<pass>') or disables ('-fno-<pass>') a single optimizer pass on top of the level")->check(CLI::IsMember(pass_flag_names))
+        ->expected(1)->allow_extra_args(false)->multi_option_policy(CLI::MultiOptionPolicy::TakeAll);
+    sub_comp->add_option("--emit", emit, "'bytecode': a binary for the 'run' command, 'c': a C source file to be compiled by a C compiler")->check(CLI::IsMember({"bytecode", "c"}))->default_val("bytecode");
+    sub_comp->add_flag("--native", native, "produces a standalone static x86-64 Linux executable instead of a binary for the 'run' command")->excludes(sub_comp->get_option("--emit"));
+    CLI::Option* pre_exec_flag = sub_comp->add_flag("--pre-execute", pre_exec, "runs the program during the build until its first input, the end or the step budget, and stores the tape, pointer and pending output in the binary, which resumes from there")
+        ->excludes(sub_comp->get_option("--emit"))->excludes(sub_comp->get_option("--native"));
+    sub_comp->add_option("--pre-execute-steps", pre_execute_steps, "maximum number of instructions executed by '--pre-execute'")->default_val(100000000)->needs(pre_exec_flag);
+    sub_comp->callback([&](){
+        comp(file_path, output_path, ascii_default, cell_bits, optimizer_options(), emit, native,
+             (pre_exec) ? std::optional<uint64_t> {pre_execute_steps} : std::nullopt);
+    });
 
     CLI11_PARSE(app, argc, argv);
 }
@@ -0,0 +1,426 @@
+#ifndef BRFK_NATIVE
+#define BRFK_NATIVE
+
+// built-in
+#include <vector>
+#include <string>
+#include <fstream>
+#include <filesystem>
+
+// local
+#include "utils.hpp"
+#include "tokens.hpp"
+#include "jit.hpp"
+#include "vm.hpp"
+#include "compiler.hpp"
+
+
+// executável ELF estático para x86-64 gerado por 'build --native', sem libc:
+// o programa é traduzido pelo mesmo 'emit_x64' do JIT e a E/S é feita por rotinas
+// emitidas junto com ele, que usam as syscalls do Linux diretamente. Além dos
+// registradores do JIT, r13 guarda os bytes pendentes em 'output' e r15/rbp a
+// posição/quantidade de bytes lidos em 'input'. Como o 'bstdout' da VM, a saída
+// só é escrita por um FLUSH e o que sobra no fim ou num panic é descartado
+template <typename Cell>
+class NativeBuilder
+{
+    private:
+
+        enum Routine : uint8_t
+        {
+            PRINT_NUM,
+            PRINT_ASCII,
+            FLUSH,
+            GROW,
+            READ_CHAR,
+            READ_NUM,
+            ROUTINE_COUNT
+        };
+
+        static const uint64_t text_base = 0x400000;
+        static const uint64_t data_base = 0x40000000;
+
+        static const uint32_t header_size = 64 + 3 * 56; // cabeçalho ELF e 3 program headers
+        static const uint32_t output_initial = 64 * 1024;
+        static const uint32_t input_size = 4096;
+
+        // segmento de dados, sem conteúdo no arquivo; a saída fica num mapeamento
+        // à parte, criado no primeiro print e dobrado por GROW quando enche
+        static const uint64_t tape = data_base;
+        static const uint64_t output = tape + FixedTape::size * sizeof(Cell); // endereço do buffer
+        static const uint64_t output_capacity = output + 8;
+        static const uint64_t input = output_capacity + 8;
+        static const uint64_t digits_end = input + input_size + 16;
+        static const uint64_t data_size = digits_end - data_base;
+
+        static inline const std::string end_of_input {"\033[91m[PANIC]: end of input\033[39m\n"};
+        static inline const std::string not_a_number {"\033[91m[PANIC]: value received by READ_NUM is not a number\033[39m\n"};
+        static inline const std::string out_of_memory {"\033[91m[PANIC]: out of memory\033[39m\n"};
+
+        Assembler as;
+        uint32_t routines[ROUTINE_COUNT];
+
+    public:
+
+        // retorna false se alguma instrução não puder ser traduzida
+        bool build(uint8_t* program, uint32_t size, uint8_t flags, const char* const path)
+        {
+            using namespace x64;
+
+            VirtualMachine<Cell> vm {TapeMode::FIXED};
+            vm.flags = flags;
+            vm.program_size = size;
+            vm.program = program;
+            vm.load();
+
+            const uint64_t strings = text_base + header_size;
+            const uint64_t code = strings + end_of_input.size() + not_a_number.size() + out_of_memory.size();
+
+            std::vector<std::pair<uint32_t, Routine>> calls;
+            auto io = [&](InstructionSet opcode)
+            {
+                Routine routine = (opcode == InstructionSet::PRINT_NUM) ? PRINT_NUM
+                                : (opcode == InstructionSet::PRINT_ASCII) ? PRINT_ASCII
+                                : (opcode == InstructionSet::READ_CHAR) ? READ_CHAR
+                                : (opcode == InstructionSet::READ_NUM) ? READ_NUM
+                                : FLUSH;
+                calls.push_back({this->as.call(), routine});
+            };
+
+            // ponto de entrada: a pilha já vem alinhada e os registradores não importam
+            this->as.mov(RBX, (int32_t)tape, 4);
+            this->as.xor_(R12, R12, 4);
+            this->as.xor_(R13, R13, 4);
+            this->as.xor_(R15, R15, 4);
+            this->as.xor_(RBP, RBP, 4);
+
+            if (!vm.template emit_x64<FixedTape>(this->as, io, 0, vm.code.size() - 1))
+                return false;
+
+            // o que não passou por um FLUSH é descartado, como no END da VM
+            this->exit(0);
+
+            this->emit_routines(strings, strings + end_of_input.size(), strings + end_of_input.size() + not_a_number.size());
+
+            for (auto [at, routine] : calls)
+                this->as.patch(at, this->routines[routine]);
+
+            std::vector<uint8_t> file;
+            file.reserve(header_size + (code - strings) + this->as.size());
+            this->write_headers(file, code, code - text_base + this->as.size());
+            file.insert(file.end(), end_of_input.begin(), end_of_input.end());
+            file.insert(file.end(), not_a_number.begin(), not_a_number.end());
+            file.insert(file.end(), out_of_memory.begin(), out_of_memory.end());
+            file.insert(file.end(), this->as.code.begin(), this->as.code.end());
+
+            std::ofstream out {path, std::ios::out | std::ios::binary};
+            if (out.bad() || !out.is_open())
+                panic("error creating file");
+
+            out.write((const char*)file.data(), file.size());
+            out.close();
+
+            std::filesystem::permissions(path, std::filesystem::perms::owner_exec | std::filesystem::perms::group_exec | std::filesystem::perms::others_exec, std::filesystem::perm_options::add);
+            return true;
+        }
+
+    private:
+
+        void exit(int32_t status)
+        {
+            using namespace x64;
+
+            this->as.mov(RAX, 231, 4); // exit_group
+            this->as.mov(RDI, status, 4);
+            this->as.syscall();
+        }
+
+        // escreve 'size' bytes a partir de 'message' e termina com status 1
+        void die(uint64_t message, uint32_t size)
+        {
+            using namespace x64;
+
+            this->as.mov(RAX, 1, 4); // write
+            this->as.mov(RDI, 1, 4);
+            this->as.mov(RSI, (int32_t)message, 4);
+            this->as.mov(RDX, size, 4);
+            this->as.syscall();
+            this->exit(1);
+        }
+
+        void emit_routines(uint64_t end_of_input_msg, uint64_t not_a_number_msg, uint64_t out_of_memory_msg)
+        {
+            using namespace x64;
+
+            Assembler& as = this->as;
+            const Mem out_at {RAX, R13, 1};
+
+            // reg = [address]
+            auto load = [&](Reg reg, uint64_t address)
+            {
+                as.mov(reg, (int32_t)address, 4);
+                as.mov(reg, Mem {reg, RSP, 1}, 8);
+            };
+
+            // FLUSH: escreve 'output' em stdout
+            {
+                this->routines[FLUSH] = as.size();
+                load(RSI, output);
+
+                uint32_t loop = as.size();
+                as.test(R13, R13, 8);
+                uint32_t done = as.jcc(EQ);
+                as.mov(RAX, 1, 4); // write
+                as.mov(RDI, 1, 4);
+                as.mov(RDX, R13, 8);
+                as.syscall();
+                as.test(RAX, RAX, 8);
+                uint32_t error = as.jcc(LE);
+                as.add(RSI, RAX, 8);
+                as.sub(R13, RAX, 8);
+                as.patch(as.jmp(), loop);
+
+                as.patch(done, as.size());
+                as.patch(error, as.size());
+                as.xor_(R13, R13, 4);
+                as.ret();
+            }
+
+            // GROW: cria o buffer de saída ou dobra a sua capacidade
+            uint32_t no_memory;
+            {
+                this->routines[GROW] = as.size();
+                load(RSI, output_capacity);
+                as.test(RSI, RSI, 8);
+                uint32_t remap = as.jcc(NE);
+
+                as.xor_(RDI, RDI, 4);         // mmap(NULL, output_initial, RW, PRIVATE | ANONYMOUS, -1, 0)
+                as.mov(RSI, output_initial, 4);
+                as.mov(RDX, 3, 4);
+                as.mov(R10, 0x22, 4);
+                as.mov(R8, -1, 8);
+                as.xor_(R9, R9, 4);
+                as.mov(RAX, 9, 4);
+                as.syscall();
+                as.mov(RDX, RSI, 8);
+                uint32_t mapped = as.jmp();
+
+                as.patch(remap, as.size());   // mremap(output, capacity, 2 * capacity, MREMAP_MAYMOVE)
+                load(RDI, output);
+                as.mov(RDX, RSI, 8);
+                as.add(RDX, RSI, 8);
+                as.mov(R10, 1, 4);
+                as.mov(RAX, 25, 4);
+                as.syscall();
+
+                as.patch(mapped, as.size());
+                as.cmp(RAX, -4096, 8);        // -errno
+                no_memory = as.jcc(A);
+                as.mov(RCX, (int32_t)output, 4);
+                as.mov(Mem {RCX, RSP, 1}, RAX, 8);
+                as.mov(RCX, (int32_t)output_capacity, 4);
+                as.mov(Mem {RCX, RSP, 1}, RDX, 8);
+                as.ret();
+            }
+
+            // garante espaço para mais 16 bytes em 'output'
+            auto reserve = [&]()
+            {
+                load(RCX, output_capacity);
+                as.lea(RAX, R13, 16, 8);
+                as.cmp(RAX, RCX, 8);
+                uint32_t room = as.jcc(BE);
+                as.patch(as.call(), this->routines[GROW]);
+                as.patch(room, as.size());
+            };
+
+            // PRINT_ASCII: um byte de r14 em 'output'
+            {
+                this->routines[PRINT_ASCII] = as.size();
+                reserve();
+
+                load(RAX, output);
+                as.mov(out_at, R14, 1);
+                as.add(R13, 1, 8);
+                as.ret();
+            }
+
+            // PRINT_NUM: r14 em decimal, os dígitos são gerados de trás para frente
+            {
+                this->routines[PRINT_NUM] = as.size();
+                reserve();
+
+                as.mov(RAX, R14, 4);
+                as.mov(RSI, (int32_t)digits_end, 4);
+                as.mov(RCX, 10, 4);
+
+                uint32_t divide = as.size();
+                as.xor_(RDX, RDX, 4);
+                as.div(RCX, 4);
+                as.add(RDX, '0', 4);
+                as.add(RSI, -1, 8);
+                as.mov(Mem {RSI, RSP, 1}, RDX, 1);
+                as.test(RAX, RAX, 4);
+                as.patch(as.jcc(NE), divide);
+
+                load(RAX, output);
+                uint32_t copy = as.size();
+                as.movzx(RDX, Mem {RSI, RSP, 1}, 1);
+                as.mov(out_at, RDX, 1);
+                as.add(R13, 1, 8);
+                as.add(RSI, 1, 8);
+                as.cmp(RSI, (int32_t)digits_end, 8);
+                as.patch(as.jcc(B), copy);
+                as.ret();
+            }
+
+            // próximo byte da entrada em eax, sem consumi-lo, ou -1 no fim
+            uint32_t peek = as.size();
+            {
+                as.cmp(R15, RBP, 8);
+                uint32_t have = as.jcc(B);
+                as.xor_(RAX, RAX, 4); // read
+                as.xor_(RDI, RDI, 4);
+                as.mov(RSI, (int32_t)input, 4);
+                as.mov(RDX, input_size, 4);
+                as.syscall();
+                as.test(RAX, RAX, 8);
+                uint32_t eof = as.jcc(LE);
+                as.mov(RBP, RAX, 8);
+                as.xor_(R15, R15, 4);
+
+                as.patch(have, as.size());
+                as.mov(RAX, (int32_t)input, 4);
+                as.movzx(RAX, Mem {RAX, R15, 1}, 1);
+                as.ret();
+
+                as.patch(eof, as.size());
+                as.mov(RAX, -1, 4);
+                as.ret();
+            }
+
+            // pula espaços em branco, como 'std::cin >> std::string' na VM,
+            // e deixa o primeiro byte seguinte em eax
+            uint32_t skip = as.size();
+            uint32_t missing_input;
+            {
+                as.patch(as.call(), peek);
+                as.cmp(RAX, -1, 4);
+                missing_input = as.jcc(EQ);
+                as.cmp(RAX, ' ', 4);
+                uint32_t space = as.jcc(EQ);
+                as.lea(RCX, RAX, -'\t', 4);
+                as.cmp(RCX, '\r' - '\t', 4);
+                uint32_t control = as.jcc(BE);
+                as.ret();
+
+                as.patch(space, as.size());
+                as.patch(control, as.size());
+                as.add(R15, 1, 8);
+                as.patch(as.jmp(), skip);
+            }
+
+            // READ_CHAR
+            {
+                this->routines[READ_CHAR] = as.size();
+                as.patch(as.call(), skip);
+                as.add(R15, 1, 8);
+                as.ret();
+            }
+
+            // READ_NUM: dígitos decimais até o primeiro byte que não for um
+            uint32_t not_digit;
+            {
+                this->routines[READ_NUM] = as.size();
+                as.patch(as.call(), skip);
+                as.lea(RCX, RAX, -'0', 4);
+                as.cmp(RCX, 9, 4);
+                not_digit = as.jcc(A);
+                as.xor_(R8, R8, 4);
+
+                uint32_t digit = as.size();
+                as.imul(R8, R8, 10);
+                as.add(R8, RCX, 4);
+                as.add(R15, 1, 8);
+                as.patch(as.call(), peek);
+                as.lea(RCX, RAX, -'0', 4);
+                as.cmp(RCX, 9, 4);
+                as.patch(as.jcc(BE), digit);
+
+                as.mov(RAX, R8, 4);
+                as.ret();
+            }
+
+            as.patch(missing_input, as.size());
+            this->die(end_of_input_msg, end_of_input.size());
+
+            as.patch(not_digit, as.size());
+            this->die(not_a_number_msg, not_a_number.size());
+
+            as.patch(no_memory, as.size());
+            this->die(out_of_memory_msg, out_of_memory.size());
+        }
+
+        static void put(std::vector<uint8_t>& out, uint64_t value, uint8_t bytes)
+        {
+            for (uint8_t i = 0; i < bytes; i++)
+                out.push_back(value >> (i * 8));
+        }
+
+        // um segmento R+X com os cabeçalhos, as mensagens e o código,
+        // um R+W só em memória com a fita e os buffers, e a pilha sem execução
+        void write_headers(std::vector<uint8_t>& out, uint64_t entry, uint64_t text_size)
+        {
+            const uint8_t ident[16] = {0x7F, 'E', 'L', 'F', 2, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+            out.insert(out.end(), ident, ident + 16);
+
+            put(out, 2, 2);           // ET_EXEC
+            put(out, 0x3E, 2);        // EM_X86_64
+            put(out, 1, 4);           // EV_CURRENT
+            put(out, entry, 8);
+            put(out, 64, 8);          // program headers logo após o cabeçalho
+            put(out, 0, 8);           // sem section headers
+            put(out, 0, 4);
+            put(out, 64, 2);
+            put(out, 56, 2);
+            put(out, 3, 2);
+            put(out, 64, 2);
+            put(out, 0, 2);
+            put(out, 0, 2);
+
+            auto segment = [&](uint32_t type, uint32_t flags, uint64_t vaddr, uint64_t filesz, uint64_t memsz)
+            {
+                put(out, type, 4);
+                put(out, flags, 4);
+                put(out, 0, 8);       // offset
+                put(out, vaddr, 8);
+                put(out, vaddr, 8);
+                put(out, filesz, 8);
+                put(out, memsz, 8);
+                put(out, 0x1000, 8);
+            };
+
+            segment(1, 4 | 1, text_base, text_size, text_size);   // PT_LOAD, R+X
+            segment(1, 4 | 2, data_base, 0, data_size);           // PT_LOAD, R+W
+            segment(0x6474E551, 4 | 2, 0, 0, 0);                  // PT_GNU_STACK
+        }
+};
+
+
+void create_native(const Program& prog, const char* const path)
+{
+    bool built;
+
+    if (prog.flags & BinaryFlags::CELL_32)
+        built = NativeBuilder<uint32_t>{}.build(prog.program, prog.size, prog.flags, path);
+    else if (prog.flags & BinaryFlags::CELL_16)
+        built = NativeBuilder<uint16_t>{}.build(prog.program, prog.size, prog.flags, path);
+    else
+        built = NativeBuilder<uint8_t>{}.build(prog.program, prog.size, prog.flags, path);
+
+    if (!built)
+        panic("the program has an instruction that can not be compiled to a native executable");
+}
+
+
+#endif
@@ -1,6 +1,13 @@
 #ifndef BRFK_OPERATIONS
 #define BRFK_OPERATIONS
 
+// built-in
+#include <vector>
+#include <string>
+#include <string_view>
+#include <memory_resource>
+#include <cctype>
+
 // local
 #include "utils.hpp"
 #include "tokens.hpp"
@@ -17,235 +24,536 @@ inline void write_to_program(uint8_t* program, uint32_t& idx, T value)
 }
 
 
-class Operation
+// como os parâmetros são codificados no binário, derivado das 'BinaryFlags'
+struct Encoding
 {
-    public:
-
-        uint16_t byte_idx;
-        OperationType type;
-
-        Operation(uint16_t bi): byte_idx(bi)
-        {
+    bool wide_jumps = false;  // WIDE_JUMPS: destinos em uint32
+    uint8_t cell_bytes = 1;   // CELL_16, CELL_32: largura dos valores de célula
 
-        }
-
-        virtual void serialize(uint8_t*, uint32_t&) = 0;
-        virtual std::string repr() = 0;
-        virtual ~Operation() = default;
-};
+    // valores de célula (comparações, atribuições, fatores) têm a largura da célula
+    inline void write_cell(uint8_t* program, uint32_t& idx, uint32_t value) const
+    {
+        if (this->cell_bytes == 1)
+            write_to_program(program, idx, (uint8_t)value);
+        else if (this->cell_bytes == 2)
+            write_to_program(program, idx, (uint16_t)value);
+        else
+            write_to_program(program, idx, value);
+    }
 
-class AddMem: public Operation
-{
-    public:
+    // somas são sempre int16, exceto com células de 32 bits
+    inline void write_add(uint8_t* program, uint32_t& idx, int32_t value) const
+    {
+        if (this->cell_bytes == 4)
+            write_to_program(program, idx, value);
+        else
+            write_to_program(program, idx, (int16_t)value);
+    }
 
-        static const uint8_t size = 3;
+    inline void write_destination(uint8_t* program, uint32_t& idx, uint32_t value) const
+    {
+        if (this->wide_jumps)
+            write_to_program(program, idx, value);
+        else
+            write_to_program(program, idx, (uint16_t)value);
+    }
 
-        int16_t value;
+    [[nodiscard]]
+    inline uint32_t add_size() const
+    {
+        return (this->cell_bytes == 4) ? 4 : 2;
+    }
 
-        AddMem(uint16_t bi, int16_t v): Operation(bi), value(v)
-        {
-            this->type = OperationType::ADD_MEM;
-        }
+    [[nodiscard]]
+    inline uint32_t destination_size() const
+    {
+        return (this->wide_jumps) ? 4 : 2;
+    }
+};
 
-        void serialize(uint8_t* prog, uint32_t& idx) override
-        {
-            write_to_program(prog, idx, (uint8_t)InstructionSet::ADD_MEM);
-            write_to_program(prog, idx, this->value);
-        }
 
-        std::string repr() override
-        {
-            std::ostringstream out;
-            out << "AddMEM value: ";
-            out << this->value;
+// célula relativa a 'mp' no código gerado por 'build --emit=c'
+inline std::string c_cell(int32_t offset)
+{
+    if (offset == 0)
+        return "mem[mp]";
+    return "mem[(uint16_t)(mp " + std::string {(offset < 0) ? "- " : "+ "} + std::to_string(std::abs(offset)) + ")]";
+}
 
-            return out.str();
-        }
+// " += n" ou " -= n"
+inline std::string c_add(int64_t value)
+{
+    return ((value < 0) ? " -= " : " += ") + std::to_string((value < 0) ? -value : value);
+}
 
-        ~AddMem() = default;
-};
 
-class AddMPTR: public Operation
+// bits de 'Operations::flags'
+namespace OperationFlags
 {
-    public:
+    enum : uint8_t
+    {
+        ASCII  = 1 << 0,    // PRINT, READ: em ASCII em vez de numérico
+        LEFT   = 1 << 1,    // LOOP: um '[', sem ele é um ']'
+        NEVER  = 1 << 2,    // LOOP: ']' a que a célula sempre chega igual ao valor de comparação, nada é emitido ('[' usado como if)
+        ALWAYS = 1 << 3,    // LOOP: ']' a que a célula sempre chega diferente, vira JUMP
+        AUTO   = 1 << 4     // FLUSH: posto pelo parser depois dos prints, o código não usa 'f'
+    };
+}
 
-        static const uint8_t size = 3;
 
-        int16_t value;
+// o programa em struct-of-arrays: a operação 'i' ocupa a posição 'i' de cada coluna
+// e os passes percorrem as colunas em ordem; os operandos de tamanho variável
+// ficam em 'terms' e 'text', apontados por 'links'
+struct Operations
+{
+    struct Term
+    {
+        int16_t offset;
+        uint32_t factor;
+    };
 
-        AddMPTR(uint16_t bi, int16_t v): Operation(bi), value(v)
-        {
-            this->type = OperationType::ADD_MPTR;            
-        }
+    // tokens do 'Lexer' que formaram a operação, índices no vetor de tokens
+    struct Span
+    {
+        uint32_t init;
+        uint32_t end;
+    };
+
+    // a quantidade de termos de um MUL_ADD é codificada em um uint8
+    static const uint8_t max_terms = UINT8_MAX;
+
+    std::pmr::vector<OperationType> types;
+    std::pmr::vector<uint8_t> flags;    // 'OperationFlags'
+    std::pmr::vector<int16_t> offsets;  // ADD_MEM, ASSIGN_MEM: célula relativa a 'mp'; SCAN: passo
+    std::pmr::vector<uint32_t> values;  // ADD_MEM, ADD_MPTR, ASSIGN_MPTR: valor com sinal; ASSIGN_MEM: valor;
+                                        // LOOP, SCAN: valor de comparação; MUL_ADD: quantidade de termos;
+                                        // PRINT_STRING: tamanho do texto
+    std::pmr::vector<uint32_t> links;   // LOOP: o par; MUL_ADD: primeiro termo; PRINT_STRING: início do texto
+    std::pmr::vector<uint32_t> targets; // LOOP: o salto vai para depois desta operação, o par
+                                        // ou a decidida por 'Optimizer::invert_loops'
+    std::pmr::vector<Span> spans;
+
+    std::pmr::vector<Term> terms;
+    std::pmr::string text;
+
+    // toda a memória vem de 'resource', normalmente o 'Arena' da compilação
+    explicit Operations(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+    : types(resource), flags(resource), offsets(resource), values(resource), links(resource),
+      targets(resource), spans(resource), terms(resource), text(resource)
+    {
 
-        void serialize(uint8_t* prog, uint32_t& idx) override
-        {
-            write_to_program(prog, idx, (uint8_t)InstructionSet::ADD_MP);
-            write_to_program(prog, idx, this->value);
-        }
-        std::string repr() override
-        {
-            std::ostringstream out;
-            out << "AddMPTR value: ";
-            out << this->value;
-            return out.str();
-        }
+    }
 
-        ~AddMPTR() = default;
-};
+    [[nodiscard]]
+    inline std::pmr::memory_resource* resource() const
+    {
+        return this->types.get_allocator().resource();
+    }
 
-class Loop: public Operation
-{
-    public:
+    [[nodiscard]]
+    inline uint32_t size() const
+    {
+        return this->types.size();
+    }
 
-        static const uint8_t size = 4;
+    void reserve(uint32_t size)
+    {
+        this->types.reserve(size);
+        this->flags.reserve(size);
+        this->offsets.reserve(size);
+        this->values.reserve(size);
+        this->links.reserve(size);
+        this->targets.reserve(size);
+        this->spans.reserve(size);
+    }
 
-        uint8_t comp_value;
-        uint16_t jump_destination;
+    uint32_t push(OperationType type, Span span, uint32_t value = 0, int16_t offset = 0, uint8_t flags = 0)
+    {
+        this->types.push_back(type);
+        this->flags.push_back(flags);
+        this->offsets.push_back(offset);
+        this->values.push_back(value);
+        // por referência: o 'emplace_back' de um temporário não é inlinado com 'polymorphic_allocator'
+        uint32_t none = 0;
+        this->links.push_back(none);
+        this->targets.push_back(none);
+        this->spans.push_back(span);
+        return this->size() - 1;
+    }
 
-        Loop(uint16_t bi, uint8_t cmpv, uint16_t dest)
-        : Operation(bi), comp_value(cmpv), jump_destination(dest)
-        {
-            this->type = OperationType::LOOP;
-        }
+    uint32_t push_mul_add(Span span, const std::pmr::vector<Term>& terms)
+    {
+        uint32_t idx = this->push(OperationType::MUL_ADD, span, terms.size());
+        this->links[idx] = this->terms.size();
+        this->terms.insert(this->terms.end(), terms.begin(), terms.end());
+        return idx;
+    }
 
-        void serialize(uint8_t* prog, uint32_t& idx) override
-        {
-            if (this->jump_destination > this->byte_idx) // caso seja um loop direito
-                write_to_program(prog, idx, (uint8_t)InstructionSet::JUMP_IF_EQ);
-            else // caso seja um esquerdo
-                write_to_program(prog, idx, (uint8_t)InstructionSet::JUMP_IF_DIFF);
+    uint32_t push_print_string(Span span, std::string_view text)
+    {
+        uint32_t idx = this->push(OperationType::PRINT_STRING, span, text.size());
+        this->links[idx] = this->text.size();
+        this->text.append(text);
+        return idx;
+    }
 
-            write_to_program(prog, idx, this->comp_value);
-            write_to_program(prog, idx, this->jump_destination);
-        }
+    // copia a operação 'idx' de 'from', os pares dos loops são refeitos por 'link_loops'
+    uint32_t copy(const Operations& from, uint32_t idx)
+    {
+        uint32_t copied = this->push(from.types[idx], from.spans[idx], from.values[idx], from.offsets[idx], from.flags[idx]);
 
-        std::string repr() override
+        if (from.types[idx] == OperationType::MUL_ADD)
         {
-            std::ostringstream out;
-            out << "Loop cmp_value: ";
-            out << (int)this->comp_value;
-            out << ", destination: ";
-            out << this->jump_destination;
-
-            return out.str();
+            auto first = from.terms.begin() + from.links[idx];
+            this->links[copied] = this->terms.size();
+            this->terms.insert(this->terms.end(), first, first + from.values[idx]);
         }
-
-        Loop* make_pair(uint16_t byte_idx)
+        else if (from.types[idx] == OperationType::PRINT_STRING)
         {
-            Loop* other = new Loop{byte_idx, this->comp_value, this->byte_idx};
-            this->jump_destination = byte_idx + this->size;
-            return other;
+            this->links[copied] = this->text.size();
+            this->text.append(from.string(idx));
         }
+        return copied;
+    }
 
-        ~Loop() = default;
-};
+    void clear()
+    {
+        this->types.clear();
+        this->flags.clear();
+        this->offsets.clear();
+        this->values.clear();
+        this->links.clear();
+        this->targets.clear();
+        this->spans.clear();
+        this->terms.clear();
+        this->text.clear();
+    }
 
-class Print: public Operation
-{
-    public:
+    // os termos e o texto da operação removida ficam sem uso até o próximo passe
+    void pop_back()
+    {
+        this->types.pop_back();
+        this->flags.pop_back();
+        this->offsets.pop_back();
+        this->values.pop_back();
+        this->links.pop_back();
+        this->targets.pop_back();
+        this->spans.pop_back();
+    }
 
-        static const uint8_t size = 1;
-        bool ascii = false;
+    // refaz o par e o destino de cada loop, necessário depois que um passe altera a lista
+    void link_loops()
+    {
+        std::pmr::vector<uint32_t> open {this->resource()};
 
-        Print(uint16_t bi): Operation(bi)
+        for (uint32_t i = 0; i < this->size(); i++)
         {
-            this->type = OperationType::PRINT;
-        }
+            if (this->types[i] != OperationType::LOOP)
+                continue;
 
-        void serialize(uint8_t* prog, uint32_t& idx) override
-        {
-            if (this->ascii)
-                write_to_program(prog, idx, (uint8_t)InstructionSet::PRINT_ASCII);
-            else
-                write_to_program(prog, idx, (uint8_t)InstructionSet::PRINT_NUM);
+            if (this->is_left(i))
+            {
+                open.push_back(i);
+                continue;
+            }
 
-        }
-        
-        std::string repr() override
-        {
-            std::stringstream out;
-            out << "PRINT ";
-            out << "ASCII: ";
-            out << ((this->ascii) ? "TRUE" : "FALSE");
+            uint32_t left = open.back();
+            open.pop_back();
 
-            return out.str();
+            this->links[left] = this->targets[left] = i;
+            this->links[i] = this->targets[i] = left;
         }
+    }
 
-        ~Print() = default;
-};
-
-class Read: public Operation
-{
-    public:
+    [[nodiscard]]
+    inline bool is_left(uint32_t idx) const
+    {
+        return this->flags[idx] & OperationFlags::LEFT;
+    }
 
-        static const uint8_t size = 1;
-        bool ascii = false;
+    [[nodiscard]]
+    inline std::string_view string(uint32_t idx) const
+    {
+        return std::string_view {this->text}.substr(this->links[idx], this->values[idx]);
+    }
 
-        Read(uint16_t bi): Operation(bi)
+    // tamanhos de 'InstructionSet'
+    [[nodiscard]]
+    uint32_t get_size(uint32_t idx, const Encoding& enc) const
+    {
+        switch (this->types[idx])
         {
-            this->type = OperationType::READ;
+            case OperationType::ADD_MEM:
+                return ((this->offsets[idx] != 0) ? 3 : 1) + enc.add_size();
+            case OperationType::ASSIGN_MEM:
+                return ((this->offsets[idx] != 0) ? 3 : 1) + enc.cell_bytes;
+            case OperationType::ADD_MPTR:
+            case OperationType::ASSIGN_MPTR:
+                return 3;
+            case OperationType::LOOP:
+                if (this->flags[idx] & OperationFlags::NEVER)
+                    return 0;
+                if (this->flags[idx] & OperationFlags::ALWAYS)
+                    return 1 + enc.destination_size();
+                return 1 + enc.cell_bytes + enc.destination_size();
+            case OperationType::SCAN:
+                return 3 + enc.cell_bytes;
+            case OperationType::MUL_ADD:
+                return 2 + (2 + enc.cell_bytes) * this->values[idx];
+            case OperationType::PRINT_STRING:
+                return 3 + this->values[idx];
+            case OperationType::PRINT:
+            case OperationType::READ:
+            case OperationType::FLUSH:
+                return 1;
         }
+        return 0;
+    }
 
-        void serialize(uint8_t* prog, uint32_t& idx) override
-        {
-            if (this->ascii)
-                write_to_program(prog, idx, (uint8_t)InstructionSet::READ_CHAR);
-            else
-                write_to_program(prog, idx, (uint8_t)InstructionSet::READ_NUM);
-
-        }
+    // 'positions': byte de cada operação no programa, calculado por 'layout_program'
+    void serialize(uint32_t idx, uint8_t* prog, uint32_t& byte_idx, const Encoding& enc, const std::pmr::vector<uint32_t>& positions) const
+    {
+        uint32_t value = this->values[idx];
+        int16_t offset = this->offsets[idx];
+        bool ascii = this->flags[idx] & OperationFlags::ASCII;
 
-        std::string repr() override
+        switch (this->types[idx])
         {
-            std::stringstream out;
-            out << "READ ";
-            out << "ASCII: ";
-            out << ((this->ascii) ? "TRUE" : "FALSE");
-
-            return out.str();
+            case OperationType::ADD_MEM:
+            {
+                if (offset != 0)
+                {
+                    write_to_program(prog, byte_idx, (uint8_t)InstructionSet::ADD_MEM_OFFSET);
+                    write_to_program(prog, byte_idx, offset);
+                }
+                else
+                    write_to_program(prog, byte_idx, (uint8_t)InstructionSet::ADD_MEM);
+
+                enc.write_add(prog, byte_idx, (int32_t)value);
+                break;
+            }
+            case OperationType::ADD_MPTR:
+            {
+                write_to_program(prog, byte_idx, (uint8_t)InstructionSet::ADD_MP);
+                write_to_program(prog, byte_idx, (int16_t)value);
+                break;
+            }
+            case OperationType::ASSIGN_MPTR:
+            {
+                write_to_program(prog, byte_idx, (uint8_t)InstructionSet::ASSIGN_MP);
+                write_to_program(prog, byte_idx, (int16_t)value);
+                break;
+            }
+            case OperationType::ASSIGN_MEM:
+            {
+                if (offset != 0)
+                {
+                    write_to_program(prog, byte_idx, (uint8_t)InstructionSet::ASSIGN_MEM_OFFSET);
+                    write_to_program(prog, byte_idx, offset);
+                }
+                else
+                    write_to_program(prog, byte_idx, (uint8_t)InstructionSet::ASSIGN_MEM);
+
+                enc.write_cell(prog, byte_idx, value);
+                break;
+            }
+            case OperationType::MUL_ADD:
+            {
+                write_to_program(prog, byte_idx, (uint8_t)InstructionSet::MUL_ADD);
+                write_to_program(prog, byte_idx, (uint8_t)value);
+
+                for (uint32_t t = this->links[idx]; t < this->links[idx] + value; t++)
+                {
+                    write_to_program(prog, byte_idx, this->terms[t].offset);
+                    enc.write_cell(prog, byte_idx, this->terms[t].factor);
+                }
+                break;
+            }
+            case OperationType::LOOP:
+            {
+                if (this->flags[idx] & OperationFlags::NEVER)
+                    break;
+
+                uint32_t target = this->targets[idx];
+                uint32_t destination = positions[target] + this->get_size(target, enc);
+
+                if (this->flags[idx] & OperationFlags::ALWAYS)
+                {
+                    write_to_program(prog, byte_idx, (uint8_t)InstructionSet::JUMP);
+                    enc.write_destination(prog, byte_idx, destination);
+                    break;
+                }
+
+                if (this->is_left(idx)) // caso seja um loop direito
+                    write_to_program(prog, byte_idx, (uint8_t)InstructionSet::JUMP_IF_EQ);
+                else // caso seja um esquerdo
+                    write_to_program(prog, byte_idx, (uint8_t)InstructionSet::JUMP_IF_DIFF);
+
+                enc.write_cell(prog, byte_idx, value);
+                enc.write_destination(prog, byte_idx, destination);
+                break;
+            }
+            case OperationType::SCAN:
+            {
+                write_to_program(prog, byte_idx, (uint8_t)InstructionSet::SCAN);
+                enc.write_cell(prog, byte_idx, value);
+                write_to_program(prog, byte_idx, offset);
+                break;
+            }
+            case OperationType::PRINT:
+            {
+                write_to_program(prog, byte_idx, (uint8_t)((ascii) ? InstructionSet::PRINT_ASCII : InstructionSet::PRINT_NUM));
+                break;
+            }
+            case OperationType::PRINT_STRING:
+            {
+                write_to_program(prog, byte_idx, (uint8_t)InstructionSet::PRINT_STRING);
+                write_to_program(prog, byte_idx, (uint16_t)value);
+                for (char ch: this->string(idx))
+                    write_to_program(prog, byte_idx, (uint8_t)ch);
+                break;
+            }
+            case OperationType::READ:
+            {
+                write_to_program(prog, byte_idx, (uint8_t)((ascii) ? InstructionSet::READ_CHAR : InstructionSet::READ_NUM));
+                break;
+            }
+            case OperationType::FLUSH:
+            {
+                write_to_program(prog, byte_idx, (uint8_t)InstructionSet::FLUSH);
+                break;
+            }
         }
+    }
 
-        ~Read() = default;
-};
-
-class Flush: public Operation
-{
-    public:
-
-        static const uint8_t size = 1;
+    [[nodiscard]]
+    std::string repr(uint32_t idx) const
+    {
+        std::ostringstream out;
+        uint32_t value = this->values[idx];
+        bool ascii = this->flags[idx] & OperationFlags::ASCII;
 
-        Flush(uint16_t bi): Operation(bi)
+        switch (this->types[idx])
         {
-
+            case OperationType::ADD_MEM:
+                out << "AddMEM value: " << (int32_t)value << ", offset: " << this->offsets[idx];
+                break;
+            case OperationType::ADD_MPTR:
+                out << "AddMPTR value: " << (int32_t)value;
+                break;
+            case OperationType::ASSIGN_MPTR:
+                out << "AssignMPTR value: " << (int32_t)value;
+                break;
+            case OperationType::ASSIGN_MEM:
+                out << "AssignMEM value: " << value << ", offset: " << this->offsets[idx];
+                break;
+            case OperationType::MUL_ADD:
+                out << "MulAdd terms:";
+                for (uint32_t t = this->links[idx]; t < this->links[idx] + value; t++)
+                    out << " [" << this->terms[t].offset << "] * " << this->terms[t].factor;
+                break;
+            case OperationType::LOOP:
+                out << "Loop cmp_value: " << value << ", target: " << this->targets[idx];
+                if (this->flags[idx] & OperationFlags::NEVER)
+                    out << ", never taken";
+                else if (this->flags[idx] & OperationFlags::ALWAYS)
+                    out << ", always taken";
+                break;
+            case OperationType::SCAN:
+                out << "Scan cmp_value: " << value << ", stride: " << this->offsets[idx];
+                break;
+            case OperationType::PRINT:
+                out << "PRINT ASCII: " << ((ascii) ? "TRUE" : "FALSE");
+                break;
+            case OperationType::PRINT_STRING:
+                out << "PRINT_STRING length: " << value;
+                break;
+            case OperationType::READ:
+                out << "READ ASCII: " << ((ascii) ? "TRUE" : "FALSE");
+                break;
+            case OperationType::FLUSH:
+                out << "FLUSH";
+                break;
         }
+        return out.str();
+    }
 
-        void serialize(uint8_t* prog, uint32_t& idx) override
-        {
-            write_to_program(prog, idx, (uint8_t)InstructionSet::FLUSH);
-        }
+    // um comando C, sem indentação
+    [[nodiscard]]
+    std::string to_c(uint32_t idx) const
+    {
+        uint32_t value = this->values[idx];
+        int16_t offset = this->offsets[idx];
+        bool ascii = this->flags[idx] & OperationFlags::ASCII;
 
-        std::string repr() override
+        switch (this->types[idx])
         {
-            return "FLUSH";
+            case OperationType::ADD_MEM:
+                return c_cell(offset) + c_add((int32_t)value) + ";";
+            case OperationType::ADD_MPTR:
+                return "mp" + c_add((int32_t)value) + ";";
+            case OperationType::ASSIGN_MPTR:
+                return "mp = " + std::to_string((uint16_t)value) + ";";
+            case OperationType::ASSIGN_MEM:
+                return c_cell(offset) + " = " + std::to_string(value) + "u;";
+            case OperationType::MUL_ADD:
+            {
+                // o produto é sempre feito em 'unsigned' para que dê a volta sem UB
+                std::string out {"if (mem[mp]) { cell n = mem[mp];"};
+                for (uint32_t t = this->links[idx]; t < this->links[idx] + value; t++)
+                    out.append(" " + c_cell(this->terms[t].offset) + " += (cell)(n * " + std::to_string(this->terms[t].factor) + "u);");
+                out.append(" }");
+                return out;
+            }
+            case OperationType::LOOP:
+                if (this->is_left(idx))
+                    return "while (mem[mp] != " + std::to_string(value) + "u) {";
+                return "}";
+            case OperationType::SCAN:
+                return "while (mem[mp] != " + std::to_string(value) + "u) mp" + c_add(offset) + ";";
+            case OperationType::PRINT:
+                return (ascii) ? "brfk_print_ascii(mem[mp]);" : "brfk_print_num(mem[mp]);";
+            case OperationType::PRINT_STRING:
+            {
+                std::ostringstream out;
+                out << "brfk_print_string(\"";
+                // escapes octais de 3 dígitos, um caractere seguinte nunca é lido como parte deles
+                for (char ch: this->string(idx))
+                {
+                    uint8_t byte = ch;
+                    if (ch == '"' || ch == '\\' || ch == '?' || !std::isprint(byte))
+                        out << '\\' << (char)('0' + byte / 64) << (char)('0' + byte / 8 % 8) << (char)('0' + byte % 8);
+                    else
+                        out << ch;
+                }
+                out << "\", " << value << ");";
+                return out.str();
+            }
+            case OperationType::READ:
+                return (ascii) ? "mem[mp] = brfk_read_char();" : "mem[mp] = brfk_read_num();";
+            case OperationType::FLUSH:
+                return "brfk_flush();";
         }
-
-
-        ~Flush() = default;
+        return {};
+    }
 };
 
-struct PsrOperation
-{
-    Operation* oprt;
 
-    const Token* init;
-    const Token* end;
+// calcula o byte em que cada operação começa ('positions'),
+// retorna o tamanho em bytes do programa
+uint32_t layout_program(const Operations& operations, const Encoding& enc, std::pmr::vector<uint32_t>& positions)
+{
+    uint32_t byte_idx = 0;
+    positions.resize(operations.size());
 
-    ~PsrOperation()
+    for (uint32_t i = 0; i < operations.size(); i++)
     {
-        delete this->oprt;
+        positions[i] = byte_idx;
+        byte_idx += operations.get_size(i, enc);
     }
-};
+
+    return byte_idx;
+}
 
 
-#endif
\ No newline at end of file
+#endif
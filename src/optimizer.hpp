@@ -0,0 +1,1159 @@
+#ifndef BRFK_OPTIMIZER
+#define BRFK_OPTIMIZER
+
+// built-in
+#include <vector>
+#include <map>
+#include <bitset>
+#include <string>
+#include <optional>
+#include <type_traits>
+
+// local
+#include "utils.hpp"
+#include "operations.hpp"
+#include "tokens.hpp"
+
+
+// passos de 'Optimizer', na ordem em que rodam
+enum class Pass : uint8_t
+{
+    MUL_LOOPS,
+    CLEAR_LOOPS,
+    SCAN_LOOPS,
+    UNROLL_LOOPS,
+    FOLD_ASSIGNMENTS,
+    DEAD_CODE,
+    SINK_POINTER_MOVES,
+    PROPAGATE_CONSTANTS,
+    MERGE_PRINTS,
+    INVERT_LOOPS,
+    COUNT
+};
+
+// nomes usados por '-f<pass>' e '-fno-<pass>'
+inline const char* const pass_names[] =
+{
+    "mul-loops",
+    "clear-loops",
+    "scan-loops",
+    "unroll-loops",
+    "fold-assignments",
+    "dead-code",
+    "sink-pointer-moves",
+    "propagate-constants",
+    "merge-prints",
+    "invert-loops"
+};
+static_assert(std::size(pass_names) == (size_t)Pass::COUNT);
+
+struct OptimizerOptions
+{
+    std::bitset<(size_t)Pass::COUNT> passes;
+    uint32_t unroll_limit = 0; // máximo de operações geradas ao desenrolar um loop, 0 desliga
+
+    // -O0 não otimiza, -O1 só troca loops comuns por instruções próprias e junta as
+    // somas de cada bloco, -O2 acrescenta as análises dos valores conhecidos da fita
+    // e -O3 desenrola loops
+    static OptimizerOptions level(uint8_t level, uint32_t unroll_limit = 0)
+    {
+        OptimizerOptions options;
+        options.unroll_limit = unroll_limit;
+
+        if (level >= 1)
+        {
+            for (Pass pass: {Pass::MUL_LOOPS, Pass::CLEAR_LOOPS, Pass::SCAN_LOOPS, Pass::FOLD_ASSIGNMENTS, Pass::SINK_POINTER_MOVES})
+                options.passes.set((size_t)pass);
+        }
+        if (level >= 2)
+        {
+            for (Pass pass: {Pass::DEAD_CODE, Pass::PROPAGATE_CONSTANTS, Pass::MERGE_PRINTS, Pass::INVERT_LOOPS})
+                options.passes.set((size_t)pass);
+        }
+        if (level >= 3)
+            options.passes.set((size_t)Pass::UNROLL_LOOPS);
+
+        return options;
+    }
+
+    // 'flag' é '<pass>' ou 'no-<pass>', retorna false se o passo não existe
+    bool toggle(const std::string& flag)
+    {
+        bool enable = flag.compare(0, 3, "no-") != 0;
+        std::string name = (enable) ? flag : flag.substr(3);
+
+        for (size_t pass = 0; pass < (size_t)Pass::COUNT; pass++)
+        {
+            if (name == pass_names[pass])
+            {
+                this->passes.set(pass, enable);
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+
+// 'Cell' é o tipo da célula da fita, toda a aritmética
+// de valores é feita nele para que as dobras deem a volta como na VM
+template <typename Cell>
+class Optimizer
+{
+    private:
+
+        Operations& operations;
+        OptimizerOptions options;
+        std::pmr::memory_resource* resource; // o de 'operations', usado por todas as estruturas dos passes
+        Operations spare;                    // saída do passo atual, trocada com 'operations' no fim dele
+
+        // valores conhecidos das células, indexados pela posição relativa a 'mp' de quando
+        // o estado foi (re)iniciado, nulos quando desconhecidos; no início do programa
+        // ('zeros') toda célula ainda não escrita vale 0
+        struct KnownTape
+        {
+            std::pmr::map<int64_t, std::optional<Cell>> cells;
+            bool zeros = false;
+            int64_t mp = 0;
+
+            explicit KnownTape(std::pmr::memory_resource* resource): cells(resource)
+            {
+
+            }
+
+            KnownTape(const KnownTape& other, std::pmr::memory_resource* resource)
+            : cells(other.cells, resource), zeros(other.zeros), mp(other.mp)
+            {
+
+            }
+
+            std::optional<Cell> get(int32_t offset) const
+            {
+                auto cell = this->cells.find(this->mp + offset);
+                if (cell != this->cells.end())
+                    return cell->second;
+                return (this->zeros) ? std::optional<Cell> {0} : std::nullopt;
+            }
+
+            void set(int32_t offset, std::optional<Cell> value)
+            {
+                this->cells[this->mp + offset] = value;
+            }
+
+            // longe da origem a fita fixa dá a volta e duas posições seriam a mesma célula
+            void move(int32_t amount)
+            {
+                this->mp += amount;
+                if (this->mp < INT16_MIN || this->mp > INT16_MAX)
+                    this->reset();
+            }
+
+            void reset()
+            {
+                this->cells.clear();
+                this->zeros = false;
+                this->mp = 0;
+            }
+        };
+
+    public:
+
+        uint32_t dead_bytes = 0; // tamanho do código removido por 'eliminate_dead_code'
+
+        Optimizer(Operations& ops, const OptimizerOptions& options)
+        : operations(ops), options(options), resource(ops.resource()), spare(ops.resource())
+        {
+
+        }
+
+        // roda os passos habilitados em 'options', na ordem de 'Pass'
+        void optimize()
+        {
+            for (size_t pass = 0; pass < (size_t)Pass::COUNT; pass++)
+            {
+                if (this->options.passes.test(pass))
+                    this->run_pass((Pass)pass);
+            }
+        }
+
+    private:
+
+        void run_pass(Pass pass)
+        {
+            switch (pass)
+            {
+                case Pass::MUL_LOOPS:
+                    this->mul_loops();
+                    break;
+                case Pass::CLEAR_LOOPS:
+                    this->clear_loops();
+                    break;
+                case Pass::SCAN_LOOPS:
+                    this->scan_loops();
+                    break;
+                case Pass::UNROLL_LOOPS:
+                    this->unroll_loops();
+                    break;
+                case Pass::FOLD_ASSIGNMENTS:
+                    this->fold_assignments();
+                    break;
+                case Pass::DEAD_CODE:
+                    this->eliminate_dead_code();
+                    break;
+                case Pass::SINK_POINTER_MOVES:
+                    this->sink_pointer_moves();
+                    break;
+                case Pass::PROPAGATE_CONSTANTS:
+                    this->propagate_constants();
+                    break;
+                case Pass::MERGE_PRINTS:
+                    this->merge_prints();
+                    break;
+                case Pass::INVERT_LOOPS:
+                    this->invert_loops();
+                    break;
+                case Pass::COUNT:
+                    break;
+            }
+        }
+
+        // '[-]', '[+]' (e qualquer incremento ímpar, que sempre alcança o valor
+        // de comparação) viram um único ASSIGN_MEM
+        void clear_loops()
+        {
+            Operations& ops = this->operations;
+            Operations& output = this->begin_pass();
+
+            for (uint32_t i = 0; i < ops.size(); i++)
+            {
+                if (!this->is_clear_loop(i))
+                {
+                    output.copy(ops, i);
+                    continue;
+                }
+
+                output.push(OperationType::ASSIGN_MEM, this->span(i, i + 2), ops.values[i]);
+                i += 2;
+            }
+
+            this->finish_pass();
+        }
+
+        // loops balanceados ('[->+>++<<]') que só somam e movem o ponteiro,
+        // e cuja célula do contador varia de exatamente 1 por iteração,
+        // viram um MUL_ADD (mem[mp + offset] += fator * mem[mp]) seguido de ASSIGN_MEM 0
+        void mul_loops()
+        {
+            Operations& ops = this->operations;
+            Operations& output = this->begin_pass();
+
+            std::pmr::vector<Operations::Term> terms {this->resource};
+
+            for (uint32_t i = 0; i < ops.size(); i++)
+            {
+                uint32_t right_idx;
+
+                terms.clear();
+                if (!this->is_mul_loop(i, terms, right_idx))
+                {
+                    output.copy(ops, i);
+                    continue;
+                }
+
+                output.push_mul_add(this->span(i, right_idx), terms);
+                output.push(OperationType::ASSIGN_MEM, this->span(i, right_idx), 0);
+                i = right_idx;
+            }
+
+            this->finish_pass();
+        }
+
+        // loops mais internos cujo contador tem valor conhecido na entrada são desenrolados
+        // quando as cópias do corpo cabem em 'unroll_limit' operações, e MUL_ADDs com o
+        // contador conhecido viram somas ('+8[>+4<-]' no início do programa vira '+8>+32<'
+        // e um ASSIGN_MEM 0, que os passes seguintes juntam)
+        void unroll_loops()
+        {
+            Operations& ops = this->operations;
+            Operations& output = this->begin_pass();
+
+            KnownTape tape {this->resource};
+            tape.zeros = true;
+
+            auto emit = [&](uint32_t idx)
+            {
+                std::optional<Cell> counter = tape.get(0);
+                if (ops.types[idx] != OperationType::MUL_ADD || !counter.has_value())
+                {
+                    this->apply(tape, ops, idx);
+                    output.copy(ops, idx);
+                    return;
+                }
+
+                for (uint32_t t = ops.links[idx]; t < ops.links[idx] + ops.values[idx]; t++)
+                {
+                    const Operations::Term& term = ops.terms[t];
+                    int32_t value = this->add_values(0, (Cell)(term.factor * *counter));
+                    if (value == 0)
+                        continue;
+
+                    uint32_t add = output.push(OperationType::ADD_MEM, ops.spans[idx], (uint32_t)value, term.offset);
+                    this->apply(tape, output, add);
+                }
+            };
+
+            for (uint32_t i = 0; i < ops.size(); i++)
+            {
+                if (ops.types[i] == OperationType::SCAN || ops.types[i] == OperationType::LOOP)
+                {
+                    uint32_t right_idx;
+                    uint32_t trips;
+
+                    if (this->is_innermost_loop(i, right_idx) && this->trip_count(tape, i, right_idx, trips))
+                    {
+                        for (uint32_t t = 0; t < trips; t++)
+                        {
+                            for (uint32_t j = i + 1; j < right_idx; j++)
+                                emit(j);
+                        }
+
+                        i = right_idx;
+                        continue;
+                    }
+
+                    // depois de um SCAN ou de um ']' só a célula atual é conhecida
+                    tape.reset();
+                    if (ops.types[i] == OperationType::SCAN || !ops.is_left(i))
+                        tape.set(0, (Cell)ops.values[i]);
+
+                    output.copy(ops, i);
+                    continue;
+                }
+
+                emit(i);
+            }
+
+            this->finish_pass();
+        }
+
+        // somas na mesma célula imediatamente antes de um ASSIGN_MEM seriam sobrescritas
+        // e são descartadas, somas logo depois são incorporadas ao valor atribuído
+        void fold_assignments()
+        {
+            Operations& ops = this->operations;
+            Operations& output = this->begin_pass();
+
+            for (uint32_t i = 0; i < ops.size(); i++)
+            {
+                if (ops.types[i] != OperationType::ASSIGN_MEM)
+                {
+                    output.copy(ops, i);
+                    continue;
+                }
+
+                int16_t offset = ops.offsets[i];
+
+                auto same_cell = [&](const Operations& from, uint32_t idx)
+                {
+                    return from.types[idx] == OperationType::ADD_MEM && from.offsets[idx] == offset;
+                };
+
+                uint32_t init = ops.spans[i].init;
+                while (output.size() > 0 && same_cell(output, output.size() - 1))
+                {
+                    init = output.spans.back().init;
+                    output.pop_back();
+                }
+
+                uint32_t assign = output.copy(ops, i);
+                output.spans[assign].init = init;
+
+                while (i + 1 < ops.size() && same_cell(ops, i + 1))
+                {
+                    output.values[assign] = (Cell)(output.values[assign] + ops.values[i + 1]);
+                    output.spans[assign].end = ops.spans[i + 1].end;
+                    i++;
+                }
+            }
+
+            this->finish_pass();
+        }
+
+        // remove loops e SCANs que começam com a célula já igual ao valor de comparação
+        // (os loops de comentário de BF, '][' ou o início do programa), o que deixa vizinhas
+        // somas que 'sink_pointer_moves' junta ou cancela, e o código depois do último efeito
+        // observável que só muda a fita
+        void eliminate_dead_code()
+        {
+            Operations& ops = this->operations;
+            Operations& output = this->begin_pass();
+
+            Encoding enc;
+            enc.cell_bytes = sizeof(Cell);
+
+            KnownTape tape {this->resource};
+            tape.zeros = true;
+
+            for (uint32_t i = 0; i < ops.size(); i++)
+            {
+                std::optional<Cell> current = tape.get(0);
+
+                if (ops.types[i] == OperationType::LOOP && ops.is_left(i))
+                {
+                    if (current == (Cell)ops.values[i])
+                    {
+                        for (uint32_t j = i; j <= ops.links[i]; j++)
+                            this->dead_bytes += ops.get_size(j, enc);
+                        i = ops.links[i];
+                        continue;
+                    }
+                    tape.reset();
+                }
+                else if (ops.types[i] == OperationType::LOOP)
+                {
+                    tape.reset();
+                    tape.set(0, (Cell)ops.values[i]);
+                }
+                else if (ops.types[i] == OperationType::SCAN)
+                {
+                    if (current == (Cell)ops.values[i])
+                    {
+                        this->dead_bytes += ops.get_size(i, enc);
+                        continue;
+                    }
+                    tape.reset();
+                    tape.set(0, (Cell)ops.values[i]);
+                }
+                else
+                    this->apply(tape, ops, i);
+
+                output.copy(ops, i);
+            }
+
+            // loops e SCANs ficam, podem nunca terminar
+            while (output.size() > 0 && (output.types.back() == OperationType::ADD_MEM
+                                         || output.types.back() == OperationType::ADD_MPTR
+                                         || output.types.back() == OperationType::ASSIGN_MEM
+                                         || output.types.back() == OperationType::MUL_ADD))
+            {
+                this->dead_bytes += output.get_size(output.size() - 1, enc);
+                output.pop_back();
+            }
+
+            this->finish_pass();
+        }
+
+        // dentro de um bloco sem loops nem I/O, os movimentos do ponteiro são
+        // absorvidos pelo offset de cada ADD_MEM/ASSIGN_MEM, as operações na mesma
+        // célula são combinadas e o bloco termina com no máximo um ADD_MP
+        // ('>+>+>+<<<' vira três ADD_MEM_OFFSET e nenhum ADD_MP)
+        void sink_pointer_moves()
+        {
+            Operations& ops = this->operations;
+            Operations& output = this->begin_pass();
+
+            // operações do bloco atual, a última de cada célula fica em 'cells'
+            Operations block {this->resource};
+
+            uint32_t size = ops.size();
+            uint32_t i = 0;
+            while (i < size)
+            {
+                if (!this->is_block_op(i))
+                {
+                    output.copy(ops, i);
+                    i++;
+                    continue;
+                }
+
+                // efeito final de cada célula do bloco, em ordem de offset, índices em 'block'
+                std::pmr::map<int32_t, uint32_t> cells {this->resource};
+                block.clear();
+                uint32_t init = ops.spans[i].init;
+                uint32_t end = init;
+                int32_t offset = 0;
+
+                for (; i < size && this->is_block_op(i); i++)
+                {
+                    end = ops.spans[i].end;
+
+                    if (ops.types[i] == OperationType::ADD_MPTR)
+                    {
+                        int32_t noffset = offset + (int32_t)ops.values[i];
+
+                        // offsets precisam caber em um int16, o bloco é quebrado antes disso
+                        if (noffset < INT16_MIN || noffset > INT16_MAX)
+                            break;
+
+                        offset = noffset;
+                        continue;
+                    }
+
+                    if (ops.types[i] == OperationType::FLUSH)
+                    {
+                        output.copy(ops, i);
+                        continue;
+                    }
+
+                    // a operação pode já ter offset próprio (somas de 'unroll_loops')
+                    int32_t cell = offset + ops.offsets[i];
+                    if (cell < INT16_MIN || cell > INT16_MAX)
+                        break;
+
+                    auto it = cells.find(cell);
+                    if (it == cells.end())
+                    {
+                        uint32_t idx = block.copy(ops, i);
+                        block.offsets[idx] = cell;
+                        cells[cell] = idx;
+                        continue;
+                    }
+
+                    uint32_t prev = it->second;
+                    if (ops.types[i] == OperationType::ASSIGN_MEM)
+                    {
+                        // a atribuição sobrescreve o que veio antes
+                        uint32_t idx = block.copy(ops, i);
+                        block.offsets[idx] = cell;
+                        block.spans[idx].init = block.spans[prev].init;
+                        it->second = idx;
+                    }
+                    else
+                    {
+                        if (block.types[prev] == OperationType::ASSIGN_MEM)
+                            block.values[prev] = (Cell)(block.values[prev] + ops.values[i]);
+                        else
+                            block.values[prev] = Optimizer::add_values(block.values[prev], ops.values[i]);
+                        block.spans[prev].end = ops.spans[i].end;
+                    }
+                }
+
+                for (auto& [off, idx]: cells)
+                {
+                    if (block.types[idx] == OperationType::ADD_MEM && block.values[idx] == 0)
+                        continue;
+                    output.copy(block, idx);
+                }
+
+                if (offset != 0)
+                    output.push(OperationType::ADD_MPTR, {init, end}, (uint32_t)offset);
+            }
+
+            this->finish_pass();
+        }
+
+        // interpretação abstrata a partir da fita zerada do início ('clear_memory'):
+        // somas em células conhecidas viram ASSIGN_MEM, atribuições do valor que a célula
+        // já tem, loops e SCANs que nunca executam e MUL_ADDs com contador 0 somem,
+        // movimentos com a posição conhecida viram ASSIGN_MPTR e PRINTs de células
+        // conhecidas viram PRINT_STRING. Um loop cujo corpo volta
+        // o ponteiro ao mesmo lugar só torna desconhecidas as células em que escreve,
+        // qualquer outro faz perder o estado todo
+        void propagate_constants()
+        {
+            Operations& ops = this->operations;
+            Operations& output = this->begin_pass();
+
+            KnownTape tape {this->resource};
+            tape.zeros = true;
+
+            // posições (de 'tape') escritas por cada loop aberto, nulo se o loop não é balanceado
+            std::pmr::vector<std::optional<std::pmr::vector<int64_t>>> loops {this->resource};
+
+            for (uint32_t i = 0; i < ops.size(); i++)
+            {
+                std::optional<Cell> current = tape.get(0);
+                uint32_t value = ops.values[i];
+                int16_t offset = ops.offsets[i];
+
+                switch (ops.types[i])
+                {
+                    case OperationType::LOOP:
+                    {
+                        if (!ops.is_left(i))
+                        {
+                            std::optional<std::pmr::vector<int64_t>> written = std::move(loops.back());
+                            loops.pop_back();
+
+                            if (written.has_value())
+                            {
+                                for (int64_t position: *written)
+                                    tape.cells[position] = std::nullopt;
+                            }
+                            else
+                                tape.reset();
+
+                            tape.set(0, (Cell)value);
+                            break;
+                        }
+
+                        if (current.has_value() && *current == (Cell)value)
+                        {
+                            i = ops.links[i];
+                            continue;
+                        }
+
+                        std::optional<std::pmr::vector<int64_t>> written = this->loop_writes(tape, i);
+                        if (written.has_value())
+                        {
+                            for (int64_t position: *written)
+                                tape.cells[position] = std::nullopt;
+                        }
+                        else
+                            tape.reset();
+
+                        loops.push_back(std::move(written));
+                        break;
+                    }
+                    case OperationType::SCAN:
+                    {
+                        if (current.has_value() && *current == (Cell)value)
+                            continue;
+
+                        tape.reset();
+                        tape.set(0, (Cell)value);
+                        break;
+                    }
+                    case OperationType::ADD_MEM:
+                    {
+                        std::optional<Cell> known = tape.get(offset);
+                        if (!known.has_value())
+                            break;
+
+                        uint32_t assign = output.push(OperationType::ASSIGN_MEM, ops.spans[i], (Cell)(*known + value), offset);
+                        this->apply(tape, output, assign);
+                        continue;
+                    }
+                    case OperationType::ASSIGN_MEM:
+                    {
+                        if (tape.get(offset) == (Cell)value)
+                            continue;
+                        break;
+                    }
+                    case OperationType::MUL_ADD:
+                    {
+                        if (current == (Cell)0)
+                            continue;
+                        break;
+                    }
+                    case OperationType::PRINT:
+                    {
+                        if (!current.has_value())
+                            break;
+
+                        bool ascii = ops.flags[i] & OperationFlags::ASCII;
+                        output.push_print_string(ops.spans[i], (ascii) ? std::string(1, (char)*current) : std::to_string(*current));
+                        continue;
+                    }
+                    case OperationType::ADD_MPTR:
+                    {
+                        int64_t position = tape.mp + (int32_t)value;
+
+                        // com 'zeros' a posição de 'tape' é a posição absoluta
+                        if (tape.zeros && position >= INT16_MIN && position <= INT16_MAX)
+                        {
+                            tape.move((int32_t)value);
+                            output.push(OperationType::ASSIGN_MPTR, ops.spans[i], (uint32_t)position);
+                            continue;
+                        }
+                        break;
+                    }
+                    default:
+                        break;
+                }
+
+                if (ops.types[i] != OperationType::LOOP && ops.types[i] != OperationType::SCAN)
+                    this->apply(tape, ops, i);
+                output.copy(ops, i);
+            }
+
+            this->finish_pass();
+        }
+
+        // PRINT_STRINGs separados só por código sem loops nem leituras viram um único,
+        // no lugar do último, e os FLUSHes postos pelo parser entre eles somem
+        // ('+72.a+29.a+7.a' escreve "Hel" de uma vez); um 'f' do código interrompe a junção
+        void merge_prints()
+        {
+            Operations& ops = this->operations;
+            Operations& output = this->begin_pass();
+
+            // PRINT_STRING que ainda pode crescer e as operações que vieram depois dele
+            bool open = false;
+            std::pmr::string text {this->resource};
+            Operations::Span span {};
+            std::pmr::vector<uint32_t> between {this->resource};
+
+            auto close = [&]()
+            {
+                if (open)
+                    output.push_print_string(span, text);
+                for (uint32_t idx: between)
+                    output.copy(ops, idx);
+
+                open = false;
+                between.clear();
+            };
+
+            for (uint32_t i = 0; i < ops.size(); i++)
+            {
+                switch (ops.types[i])
+                {
+                    case OperationType::PRINT_STRING:
+                    {
+                        std::string_view current = ops.string(i);
+
+                        if (open && text.size() + current.size() <= UINT16_MAX)
+                        {
+                            for (uint32_t idx: between)
+                            {
+                                if (!(ops.flags[idx] & OperationFlags::AUTO))
+                                    output.copy(ops, idx);
+                            }
+                            between.clear();
+
+                            text.append(current);
+                            span.end = ops.spans[i].end;
+                            continue;
+                        }
+
+                        close();
+                        open = true;
+                        text = current;
+                        span = ops.spans[i];
+                        continue;
+                    }
+                    case OperationType::ADD_MEM:
+                    case OperationType::ADD_MPTR:
+                    case OperationType::ASSIGN_MEM:
+                    case OperationType::ASSIGN_MPTR:
+                    case OperationType::MUL_ADD:
+                    {
+                        if (open)
+                        {
+                            between.push_back(i);
+                            continue;
+                        }
+                        break;
+                    }
+                    case OperationType::FLUSH:
+                    {
+                        if (open && (ops.flags[i] & OperationFlags::AUTO))
+                        {
+                            between.push_back(i);
+                            continue;
+                        }
+                        close();
+                        break;
+                    }
+                    default:
+                        close();
+                }
+
+                output.copy(ops, i);
+            }
+            close();
+
+            this->finish_pass();
+        }
+
+        // decide os ']' a que a célula sempre chega com o mesmo valor: igual ao de
+        // comparação o salto de volta some e o loop vira um if ('[ ... [-]]'),
+        // diferente vira JUMP. Depois de um ']' só se chega a outro ']' logo em
+        // seguida com a célula igual ao valor do primeiro, por isso em ']]' o de
+        // fora é sempre decidido, e o '[' de dentro salta direto para onde ele levaria
+        void invert_loops()
+        {
+            Operations& ops = this->operations;
+            // valor da célula atual antes da operação 'i', válido se 'known_valid'
+            bool known_valid = false;
+            Cell known = 0;
+
+            uint32_t size = ops.size();
+            for (uint32_t i = 0; i < size; i++)
+            {
+                uint32_t value = ops.values[i];
+
+                switch (ops.types[i])
+                {
+                    case OperationType::LOOP:
+                    {
+                        if (ops.is_left(i))
+                        {
+                            known_valid = false;
+                            break;
+                        }
+
+                        if (known_valid)
+                            ops.flags[i] |= (known == (Cell)value) ? OperationFlags::NEVER : OperationFlags::ALWAYS;
+
+                        // só se passa do ']' (ou se sai do '[') com a célula igual ao valor de comparação
+                        known = (Cell)value;
+                        known_valid = true;
+                        break;
+                    }
+                    case OperationType::ASSIGN_MEM:
+                    {
+                        if (ops.offsets[i] == 0)
+                        {
+                            known = (Cell)value;
+                            known_valid = true;
+                        }
+                        break;
+                    }
+                    case OperationType::ADD_MEM:
+                    {
+                        if (ops.offsets[i] == 0)
+                            known = (Cell)(known + value);
+                        break;
+                    }
+                    case OperationType::SCAN:
+                    {
+                        known = (Cell)value;
+                        known_valid = true;
+                        break;
+                    }
+                    case OperationType::PRINT:
+                    case OperationType::PRINT_STRING:
+                    case OperationType::FLUSH:
+                        break;
+                    default:
+                        known_valid = false;
+                }
+            }
+
+            for (uint32_t i = 0; i < size; i++)
+            {
+                if (ops.types[i] != OperationType::LOOP || !ops.is_left(i))
+                    continue;
+
+                uint32_t target = ops.links[i];
+
+                for (uint32_t j = target + 1; j < size && ops.types[j] == OperationType::LOOP; j++)
+                {
+                    if (ops.is_left(j) || !(ops.flags[j] & (OperationFlags::NEVER | OperationFlags::ALWAYS)))
+                        break;
+
+                    if (ops.flags[j] & OperationFlags::ALWAYS)
+                    {
+                        target = ops.links[j];
+                        break;
+                    }
+                    target = j;
+                }
+
+                ops.targets[i] = target;
+            }
+        }
+
+        // '[>]', '[<<]', '[>>>>]'... viram um único SCAN, que procura
+        // a próxima célula igual ao valor de comparação do loop
+        void scan_loops()
+        {
+            Operations& ops = this->operations;
+            Operations& output = this->begin_pass();
+
+            for (uint32_t i = 0; i < ops.size(); i++)
+            {
+                if (!this->is_single_op_loop(i, OperationType::ADD_MPTR))
+                {
+                    output.copy(ops, i);
+                    continue;
+                }
+
+                output.push(OperationType::SCAN, this->span(i, i + 2), ops.values[i], (int16_t)ops.values[i + 1]);
+                i += 2;
+            }
+
+            this->finish_pass();
+        }
+
+
+        // #################################################
+        // #                                               #
+        // #                     UTI                       #
+        // #                                               #
+        // #################################################
+
+
+        // a saída de um passo reaproveita as colunas do programa de dois passos atrás
+        [[nodiscard]]
+        Operations& begin_pass()
+        {
+            this->spare.clear();
+            this->spare.reserve(this->operations.size());
+            return this->spare;
+        }
+
+        // a saída do passo passa a ser o programa
+        void finish_pass()
+        {
+            this->spare.link_loops();
+            std::swap(this->operations, this->spare);
+        }
+
+        // do primeiro token de 'first' ao último de 'last'
+        [[nodiscard]]
+        Operations::Span span(uint32_t first, uint32_t last) const
+        {
+            return {this->operations.spans[first].init, this->operations.spans[last].end};
+        }
+
+        // loop cujo corpo é uma única operação do tipo 'body_type'
+        [[nodiscard]]
+        bool is_single_op_loop(uint32_t idx, OperationType body_type) const
+        {
+            const Operations& ops = this->operations;
+
+            if (idx + 2 >= ops.size())
+                return false;
+
+            return ops.types[idx] == OperationType::LOOP
+                && ops.is_left(idx)
+                && ops.types[idx + 1] == body_type
+                && ops.types[idx + 2] == OperationType::LOOP
+                && !ops.is_left(idx + 2);
+        }
+
+        [[nodiscard]]
+        bool is_clear_loop(uint32_t idx) const
+        {
+            return this->is_single_op_loop(idx, OperationType::ADD_MEM)
+                && (this->operations.values[idx + 1] & 1);
+        }
+
+        // percorre o corpo do loop que começa em 'idx' acumulando o efeito
+        // de cada célula, 'terms' recebe os alvos e 'right_idx' o fim do loop
+        [[nodiscard]]
+        bool is_mul_loop(uint32_t idx, std::pmr::vector<Operations::Term>& terms, uint32_t& right_idx) const
+        {
+            const Operations& ops = this->operations;
+
+            if (ops.types[idx] != OperationType::LOOP || !ops.is_left(idx) || ops.values[idx] != 0)
+                return false;
+
+            std::pmr::map<int32_t, Cell> deltas {this->resource};
+            int32_t offset = 0;
+
+            uint32_t size = ops.size();
+            uint32_t i = idx + 1;
+            for (; i < size; i++)
+            {
+                if (ops.types[i] == OperationType::ADD_MEM)
+                    deltas[offset] += ops.values[i];
+                else if (ops.types[i] == OperationType::ADD_MPTR)
+                    offset += (int32_t)ops.values[i];
+                else if (i == ops.links[idx])
+                    break;
+                else
+                    return false;
+            }
+
+            if (i == size || offset != 0)
+                return false;
+
+            // -1 por iteração executa mem[mp] vezes, +1 executa (256 - mem[mp])
+            // vezes, o que equivale a negar os fatores
+            Cell counter = deltas[0];
+            if (counter != 1 && counter != (Cell)-1)
+                return false;
+
+            deltas.erase(0);
+            for (const auto& [off, delta]: deltas)
+            {
+                if (delta == 0)
+                    continue;
+                if (off < INT16_MIN || off > INT16_MAX)
+                    return false;
+
+                Cell factor = (counter == (Cell)-1) ? delta : (Cell)-delta;
+                terms.push_back(Operations::Term {(int16_t)off, factor});
+            }
+
+            // sem alvos é só um loop de limpeza, que fica para 'clear_loops'
+            if (terms.empty() || terms.size() > Operations::max_terms)
+                return false;
+
+            right_idx = i;
+            return true;
+        }
+
+        // loop que começa em 'idx' sem loops nem SCAN no corpo, 'right_idx' recebe o fim
+        [[nodiscard]]
+        bool is_innermost_loop(uint32_t idx, uint32_t& right_idx) const
+        {
+            const Operations& ops = this->operations;
+
+            if (ops.types[idx] != OperationType::LOOP || !ops.is_left(idx))
+                return false;
+
+            for (uint32_t i = idx + 1; i < ops.size(); i++)
+            {
+                if (i == ops.links[idx])
+                {
+                    right_idx = i;
+                    return true;
+                }
+                if (ops.types[i] == OperationType::LOOP || ops.types[i] == OperationType::SCAN)
+                    return false;
+            }
+            return false;
+        }
+
+        // posições de 'tape' em que o corpo do loop que começa em 'idx' escreve, se
+        // cada iteração termina com o ponteiro onde começou (sem SCANs e com os loops
+        // internos também balanceados)
+        std::optional<std::pmr::vector<int64_t>> loop_writes(const KnownTape& tape, uint32_t idx) const
+        {
+            const Operations& ops = this->operations;
+            std::pmr::vector<int64_t> written {this->resource};
+            std::pmr::vector<int64_t> inner {this->resource};
+            int64_t offset = 0;
+
+            for (uint32_t i = idx + 1; i != ops.links[idx]; i++)
+            {
+                switch (ops.types[i])
+                {
+                    case OperationType::ADD_MEM:
+                    case OperationType::ASSIGN_MEM:
+                        written.push_back(tape.mp + offset + ops.offsets[i]);
+                        break;
+                    case OperationType::MUL_ADD:
+                        for (uint32_t t = ops.links[i]; t < ops.links[i] + ops.values[i]; t++)
+                            written.push_back(tape.mp + offset + ops.terms[t].offset);
+                        break;
+                    case OperationType::READ:
+                        written.push_back(tape.mp + offset);
+                        break;
+                    case OperationType::ADD_MPTR:
+                        offset += (int32_t)ops.values[i];
+                        break;
+                    case OperationType::LOOP:
+                        if (ops.is_left(i))
+                            inner.push_back(offset);
+                        else if (inner.back() != offset)
+                            return std::nullopt;
+                        else
+                            inner.pop_back();
+                        break;
+                    case OperationType::PRINT:
+                    case OperationType::PRINT_STRING:
+                    case OperationType::FLUSH:
+                        break;
+                    default:
+                        return std::nullopt;
+                }
+
+                // longe da origem as posições dariam a volta na fita fixa
+                if (tape.mp + offset < INT16_MIN || tape.mp + offset > INT16_MAX)
+                    return std::nullopt;
+            }
+
+            if (offset != 0)
+                return std::nullopt;
+            return {written};
+        }
+
+        // executa o loop sobre uma cópia de 'tape' enquanto o contador for conhecido,
+        // falha se ele deixar de ser ou se as cópias passarem de 'unroll_limit'
+        [[nodiscard]]
+        bool trip_count(const KnownTape& known, uint32_t idx, uint32_t right_idx, uint32_t& trips) const
+        {
+            KnownTape tape {known, this->resource};
+            Cell cmp = this->operations.values[idx];
+            uint32_t length = right_idx - idx - 1;
+
+            for (trips = 0; ; trips++)
+            {
+                std::optional<Cell> counter = tape.get(0);
+                if (!counter.has_value())
+                    return false;
+                if (*counter == cmp)
+                    return true;
+                if (length == 0 || (uint64_t)(trips + 1) * length > this->options.unroll_limit)
+                    return false;
+
+                for (uint32_t i = idx + 1; i < right_idx; i++)
+                    this->apply(tape, this->operations, i);
+            }
+        }
+
+        // efeito da operação 'idx' de 'ops', sem saltos, nos valores conhecidos
+        void apply(KnownTape& tape, const Operations& ops, uint32_t idx) const
+        {
+            uint32_t value = ops.values[idx];
+            int16_t offset = ops.offsets[idx];
+
+            switch (ops.types[idx])
+            {
+                case OperationType::ADD_MEM:
+                {
+                    std::optional<Cell> known = tape.get(offset);
+                    if (known.has_value())
+                        tape.set(offset, (Cell)(*known + value));
+                    break;
+                }
+                case OperationType::ASSIGN_MEM:
+                {
+                    tape.set(offset, (Cell)value);
+                    break;
+                }
+                case OperationType::ADD_MPTR:
+                {
+                    tape.move((int32_t)value);
+                    break;
+                }
+                case OperationType::MUL_ADD:
+                {
+                    std::optional<Cell> counter = tape.get(0);
+                    for (uint32_t t = ops.links[idx]; t < ops.links[idx] + value; t++)
+                    {
+                        const Operations::Term& term = ops.terms[t];
+                        std::optional<Cell> known = tape.get(term.offset);
+                        if (counter.has_value() && known.has_value())
+                            tape.set(term.offset, (Cell)(*known + term.factor * *counter));
+                        else
+                            tape.set(term.offset, std::nullopt);
+                    }
+                    break;
+                }
+                case OperationType::READ:
+                {
+                    tape.set(0, std::nullopt);
+                    break;
+                }
+                case OperationType::PRINT:
+                case OperationType::PRINT_STRING:
+                case OperationType::FLUSH:
+                    break;
+                default:
+                    tape.reset();
+            }
+        }
+
+        // operações que podem fazer parte de um bloco em 'sink_pointer_moves'
+        [[nodiscard]]
+        bool is_block_op(uint32_t idx) const
+        {
+            switch (this->operations.types[idx])
+            {
+                case OperationType::ADD_MEM:
+                case OperationType::ADD_MPTR:
+                case OperationType::ASSIGN_MEM:
+                case OperationType::FLUSH:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        // soma em aritmética de célula, o resultado fica na faixa com sinal da célula
+        [[nodiscard]]
+        static inline int32_t add_values(int32_t a, int32_t b)
+        {
+            return (std::make_signed_t<Cell>)(Cell)((Cell)a + (Cell)b);
+        }
+};
+
+
+#endif
@@ -0,0 +1,396 @@
+#ifndef BRFK_STATIC
+#define BRFK_STATIC
+
+// built-in
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// local
+#include "utils.hpp"
+#include "tokens.hpp"
+#include "tape.hpp"
+#include "vm.hpp"
+
+
+// compilação de programas fixos junto com o código C++ que os usa (C++17):
+//
+//     static constexpr char kernel[] = "+65 .a";
+//     StaticProgram<kernel>::run();
+//
+// o código fonte é analisado em avaliação constante ('Lexer' e 'Parser' usam
+// std::string/std::vector e não podem), cada operação vira código instanciado
+// por template e o compilador do C++ pode otimizar o programa inteiro junto com
+// quem o chama. Erros no código fonte chegam a 'panic', que não é constexpr,
+// e viram erros de compilação
+
+
+struct StaticToken
+{
+    TokenType type = TokenType::lEOF;
+    char ch = 0;
+    uint64_t number = 0;
+};
+
+
+// mesma gramática de 'Lexer', sem recuperação de erros
+struct StaticLexer
+{
+    const char* source;
+    size_t idx = 0;
+
+    constexpr StaticToken next()
+    {
+        while (true)
+        {
+            char ch = this->source[this->idx];
+
+            if (ch == 0)
+                return {TokenType::lEOF, 0, 0};
+
+            if (ch == ' ' || ch == '\r' || ch == '\t' || ch == '\n')
+            {
+                this->idx++;
+                continue;
+            }
+
+            if (ch == '/' && this->source[this->idx + 1] == '/')
+            {
+                while (this->source[this->idx] != 0 && this->source[this->idx] != '\n')
+                    this->idx++;
+                continue;
+            }
+
+            if (ch == '/' && this->source[this->idx + 1] == '*')
+            {
+                this->idx += 2;
+                while (this->source[this->idx] != 0 && !(this->source[this->idx] == '*' && this->source[this->idx + 1] == '/'))
+                    this->idx++;
+                if (this->source[this->idx] != 0)
+                    this->idx += 2;
+                continue;
+            }
+
+            if (ch >= '0' && ch <= '9')
+            {
+                uint64_t number = 0;
+                while (this->source[this->idx] >= '0' && this->source[this->idx] <= '9')
+                    number = number * 10 + (this->source[this->idx++] - '0');
+                return {TokenType::NUMBER, 0, number};
+            }
+
+            this->idx++;
+            switch (ch)
+            {
+                case '>':
+                case '<':
+                    return {TokenType::ADD_MPTR, ch, 0};
+                case '+':
+                case '-':
+                    return {TokenType::ADD_MEM, ch, 0};
+                case '[':
+                    return {TokenType::LOOP_LEFT, ch, 0};
+                case ']':
+                    return {TokenType::LOOP_RIGHT, ch, 0};
+                case '.':
+                    return {TokenType::PRINT, ch, 0};
+                case ',':
+                    return {TokenType::READ, ch, 0};
+                case 'f':
+                    return {TokenType::FLUSH, ch, 0};
+                case 'a':
+                    return {TokenType::ASCII, ch, 0};
+                case 'n':
+                    return {TokenType::NUMERIC, ch, 0};
+                default:
+                    panic("invalid char");
+            }
+        }
+    }
+};
+
+
+// LOOP é usado pelos dois lados, 'pair' é o índice do outro
+struct StaticOperation
+{
+    OperationType type = OperationType::FLUSH;
+    int64_t value = 0;   // ADD_MEM, ADD_MPTR: soma, LOOP: valor comparado
+    bool ascii = false;  // PRINT, READ
+    bool open = false;   // LOOP: '['
+    size_t pair = 0;
+};
+
+
+// escreve as operações de 'source' em 'out' (só conta com nullptr)
+// e retorna a quantidade, seguindo 'Parser'
+constexpr size_t static_parse(const char* source, bool ascii_default, StaticOperation* out)
+{
+    const size_t max_depth = 256;
+
+    bool has_flush = false;
+    for (StaticLexer lexer {source}; !has_flush; )
+    {
+        StaticToken tk = lexer.next();
+        if (tk.type == TokenType::lEOF)
+            break;
+        has_flush = tk.type == TokenType::FLUSH;
+    }
+
+    size_t count = 0;
+    size_t loops[max_depth] = {};
+    size_t depth = 0;
+
+    auto emit = [&](StaticOperation op)
+    {
+        if (out != nullptr)
+            out[count] = op;
+        count++;
+    };
+
+    StaticLexer lexer {source};
+    StaticToken tk = lexer.next();
+
+    while (tk.type != TokenType::lEOF)
+    {
+        switch (tk.type)
+        {
+            case TokenType::ADD_MEM:
+            case TokenType::ADD_MPTR:
+            {
+                TokenType type = tk.type;
+                int64_t value = 0;
+
+                do
+                {
+                    bool negative = tk.ch == '-' || tk.ch == '<';
+                    int64_t ivalue = 1;
+
+                    tk = lexer.next();
+                    if (tk.type == TokenType::NUMBER)
+                    {
+                        ivalue = tk.number;
+                        tk = lexer.next();
+                    }
+                    value += negative ? -ivalue : ivalue;
+                }
+                while (tk.type == type);
+
+                if (value != 0)
+                    emit({(type == TokenType::ADD_MEM) ? OperationType::ADD_MEM : OperationType::ADD_MPTR, value});
+                break;
+            }
+
+            case TokenType::PRINT:
+            case TokenType::READ:
+            {
+                TokenType type = tk.type;
+                size_t first = count;
+
+                while (tk.type == type)
+                {
+                    StaticOperation op;
+                    op.type = (type == TokenType::PRINT) ? OperationType::PRINT : OperationType::READ;
+                    op.ascii = ascii_default;
+                    emit(op);
+                    tk = lexer.next();
+                }
+                size_t last = count;
+
+                if (type == TokenType::PRINT && !has_flush)
+                    emit({OperationType::FLUSH});
+
+                bool suffix = (ascii_default) ? tk.type == TokenType::NUMERIC : tk.type == TokenType::ASCII;
+                if (suffix)
+                {
+                    for (size_t i = first; out != nullptr && i < last; i++)
+                        out[i].ascii = !ascii_default;
+                    tk = lexer.next();
+                }
+                break;
+            }
+
+            case TokenType::LOOP_LEFT:
+            {
+                StaticOperation op;
+                op.type = OperationType::LOOP;
+                op.open = true;
+
+                tk = lexer.next();
+                if (tk.type == TokenType::NUMBER)
+                {
+                    op.value = tk.number;
+                    tk = lexer.next();
+                }
+
+                if (depth == max_depth)
+                    panic("loops nested too deeply");
+                loops[depth++] = count;
+                emit(op);
+                break;
+            }
+
+            case TokenType::LOOP_RIGHT:
+            {
+                if (depth == 0)
+                    panic("']' matchless");
+
+                StaticOperation op;
+                op.type = OperationType::LOOP;
+                op.pair = loops[--depth];
+                if (out != nullptr)
+                {
+                    op.value = out[op.pair].value;
+                    out[op.pair].pair = count;
+                }
+                emit(op);
+                tk = lexer.next();
+                break;
+            }
+
+            case TokenType::FLUSH:
+            {
+                emit({OperationType::FLUSH});
+                tk = lexer.next();
+                break;
+            }
+
+            case TokenType::NUMBER:
+            {
+                panic("unexpected number");
+                break;
+            }
+
+            case TokenType::ASCII:
+            {
+                panic("unexpected ASCII identifier ('a')");
+                break;
+            }
+
+            case TokenType::NUMERIC:
+            {
+                panic("unexpected numeric identifier ('n')");
+                break;
+            }
+
+            default:
+                panic("unexpected token");
+        }
+    }
+
+    if (depth != 0)
+        panic("'[' matchless");
+
+    return count;
+}
+
+template <size_t Size>
+constexpr std::array<StaticOperation, Size> static_compile(const char* source, bool ascii_default)
+{
+    std::array<StaticOperation, Size> code {};
+    static_parse(source, ascii_default, code.data());
+    return code;
+}
+
+
+// 'Source' precisa ter ligação estática ou externa (um 'static constexpr char[]'),
+// a execução usa a fita e a E/S de uma 'VirtualMachine'
+template <const char* Source, typename Cell = uint8_t, bool AsciiDefault = false>
+class StaticProgram
+{
+    public:
+
+        static constexpr size_t size = static_parse(Source, AsciiDefault, nullptr);
+        static constexpr std::array<StaticOperation, size> code = static_compile<size>(Source, AsciiDefault);
+
+        static void run(VirtualMachine<Cell>& vm)
+        {
+            if (vm.tape_mode == TapeMode::GROWABLE)
+                StaticProgram::run<GrowableTape>(vm);
+            else
+                StaticProgram::run<FixedTape>(vm);
+        }
+
+        static void run()
+        {
+            VirtualMachine<Cell> vm;
+            StaticProgram::run(vm);
+        }
+
+    private:
+
+        template <typename Tape>
+        static void run(VirtualMachine<Cell>& vm)
+        {
+            typename Tape::Index mp = vm.mp;
+            StaticProgram::block<Tape, 0, size>(vm, vm.mem, mp);
+            vm.mp = mp;
+        }
+
+        // fronteira entre operações do mesmo nível perto do meio de [First, Last),
+        // dividir ao meio mantém a profundidade dos templates em O(log n) por loop
+        static constexpr size_t split(size_t first, size_t last)
+        {
+            size_t middle = first + (last - first) / 2;
+            size_t previous = first;
+
+            for (size_t i = first; i < last; )
+            {
+                size_t next = (code[i].open) ? code[i].pair + 1 : i + 1;
+                if (next >= last)
+                    return previous;
+                if (next >= middle)
+                    return next;
+                previous = next;
+                i = next;
+            }
+            return previous;
+        }
+
+        // executa as operações de [First, Last)
+        template <typename Tape, size_t First, size_t Last>
+        static inline void block(VirtualMachine<Cell>& vm, Cell* mem, typename Tape::Index& mp)
+        {
+            if constexpr (First == Last)
+                return;
+            else if constexpr (code[First].open && code[First].pair + 1 == Last)
+            {
+                while (mem[mp] != (Cell)code[First].value)
+                    StaticProgram::block<Tape, First + 1, code[First].pair>(vm, mem, mp);
+            }
+            else if constexpr (First + 1 == Last)
+                StaticProgram::step<Tape, First>(vm, mem, mp);
+            else
+            {
+                constexpr size_t middle = StaticProgram::split(First, Last);
+                StaticProgram::block<Tape, First, middle>(vm, mem, mp);
+                StaticProgram::block<Tape, middle, Last>(vm, mem, mp);
+            }
+        }
+
+        template <typename Tape, size_t I>
+        static inline void step(VirtualMachine<Cell>& vm, Cell* mem, typename Tape::Index& mp)
+        {
+            constexpr StaticOperation op = code[I];
+
+            if constexpr (op.type == OperationType::ADD_MEM)
+                mem[mp] += (Cell)op.value;
+            else if constexpr (op.type == OperationType::ADD_MPTR)
+                mp += (typename Tape::Index)op.value;
+            else if constexpr (op.type == OperationType::PRINT && op.ascii)
+                vm.bstdout.push_back((char)mem[mp]);
+            else if constexpr (op.type == OperationType::PRINT)
+                vm.bstdout.append(std::to_string(mem[mp]));
+            else if constexpr (op.type == OperationType::READ && op.ascii)
+                mem[mp] = (uint8_t)vm.read_ch();
+            else if constexpr (op.type == OperationType::READ)
+                mem[mp] = vm.read_num();
+            else if constexpr (op.type == OperationType::FLUSH)
+            {
+                std::cout << vm.bstdout << std::flush;
+                vm.bstdout.clear();
+            }
+        }
+};
+
+
+#endif
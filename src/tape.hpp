@@ -0,0 +1,194 @@
+#ifndef BRFK_TAPE
+#define BRFK_TAPE
+
+// built-in
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <sys/mman.h>
+    #include <signal.h>
+    #include <unistd.h>
+    #define BRFK_GROWABLE_TAPE
+#endif
+
+// local
+#include "utils.hpp"
+
+
+enum class TapeMode
+{
+    FIXED,
+    GROWABLE
+};
+
+
+// fita de 65536 células, 'mp' dá a volta nas extremidades
+struct FixedTape
+{
+    using Index = uint16_t;
+
+    static const bool wraps = true;
+    static const uint32_t size = UINT16_MAX + 1;
+
+    static inline Index at(Index mp, int32_t offset)
+    {
+        return mp + offset;
+    }
+
+    static inline Index assign(int32_t value)
+    {
+        return value;
+    }
+
+    template <typename Cell>
+    static inline intptr_t begin()
+    {
+        return 0;
+    }
+
+    template <typename Cell>
+    static inline intptr_t end()
+    {
+        return size;
+    }
+};
+
+
+// fita que cresce nos dois sentidos: uma região grande é reservada com PROT_NONE
+// e 'mp' começa no meio dela, as páginas são liberadas sob demanda pelo handler
+// de SIGSEGV quando o programa as toca, assim nenhum acesso precisa verificar limites
+// e um programa pequeno só usa as poucas páginas que realmente visita
+struct GrowableTape
+{
+    using Index = intptr_t; // relativo ao meio da região
+
+    static const bool wraps = false;
+    static const size_t reserve_size = (size_t)1 << 32;
+    static const size_t chunk_size = 64 * 1024;
+
+    // só existe uma fita crescente por processo, o handler precisa dos limites
+    static inline uint8_t* region = nullptr;
+    static inline uint8_t* origin = nullptr;
+
+    static inline Index at(Index mp, int32_t offset)
+    {
+        return mp + offset;
+    }
+
+    // ASSIGN_MP guarda posições da fita de 16 bits, que aqui são relativas à origem
+    static inline Index assign(int32_t value)
+    {
+        return (int16_t)value;
+    }
+
+    // o primeiro e o último bloco da região nunca são liberados e servem de guarda,
+    // os limites são dados em células de tipo 'Cell'
+    template <typename Cell>
+    static inline intptr_t begin()
+    {
+        return (-(intptr_t)(reserve_size / 2) + (intptr_t)chunk_size) / (intptr_t)sizeof(Cell);
+    }
+
+    template <typename Cell>
+    static inline intptr_t end()
+    {
+        return (intptr_t)(reserve_size / 2 - chunk_size) / (intptr_t)sizeof(Cell);
+    }
+
+#ifdef BRFK_GROWABLE_TAPE
+    static inline struct sigaction previous_segv;
+    static inline struct sigaction previous_bus;
+
+    // retorna o endereço da célula 0
+    static uint8_t* create()
+    {
+        if (GrowableTape::region != nullptr)
+            panic("only one growable tape can exist per process");
+
+        void* region = mmap(nullptr, reserve_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (region == MAP_FAILED)
+            panic("could not reserve the tape");
+
+        GrowableTape::region = (uint8_t*)region;
+        GrowableTape::origin = GrowableTape::region + reserve_size / 2;
+
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = GrowableTape::fault_handler;
+        action.sa_flags = SA_SIGINFO | SA_NODEFER;
+        sigemptyset(&action.sa_mask);
+
+        sigaction(SIGSEGV, &action, &GrowableTape::previous_segv);
+        sigaction(SIGBUS, &action, &GrowableTape::previous_bus);
+
+        return GrowableTape::origin;
+    }
+
+    static void destroy()
+    {
+        if (GrowableTape::region == nullptr)
+            return;
+
+        sigaction(SIGSEGV, &GrowableTape::previous_segv, nullptr);
+        sigaction(SIGBUS, &GrowableTape::previous_bus, nullptr);
+
+        munmap(GrowableTape::region, reserve_size);
+        GrowableTape::region = nullptr;
+        GrowableTape::origin = nullptr;
+    }
+
+    // descarta todas as páginas liberadas, voltando a fita para zero
+    static void clear()
+    {
+        mmap(GrowableTape::region, reserve_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+    }
+
+    static void fault_handler(int sig, siginfo_t* info, void* context)
+    {
+        uint8_t* addr = (uint8_t*)info->si_addr;
+
+        if (addr >= GrowableTape::origin + GrowableTape::begin<uint8_t>() && addr < GrowableTape::origin + GrowableTape::end<uint8_t>())
+        {
+            size_t chunk = (addr - GrowableTape::region) & ~(chunk_size - 1);
+            if (mprotect(GrowableTape::region + chunk, chunk_size, PROT_READ | PROT_WRITE) == 0)
+                return;
+        }
+        else if (addr >= GrowableTape::region && addr < GrowableTape::region + reserve_size)
+        {
+            static const char message[] = "\033[91m[PANIC]: tape exhausted\033[39m\n";
+            (void)!write(STDOUT_FILENO, message, sizeof(message) - 1);
+            _exit(1);
+        }
+
+        // a falha não é da fita, repassa para quem tratava o sinal antes
+        struct sigaction& previous = (sig == SIGSEGV) ? GrowableTape::previous_segv : GrowableTape::previous_bus;
+        if (previous.sa_flags & SA_SIGINFO)
+            previous.sa_sigaction(sig, info, context);
+        else if (previous.sa_handler != SIG_DFL && previous.sa_handler != SIG_IGN)
+            previous.sa_handler(sig);
+        else
+            sigaction(sig, &previous, nullptr); // a instrução falha de novo e o processo termina
+    }
+#else
+    static uint8_t* create()
+    {
+        panic("growable tape is not supported on this platform");
+        return nullptr;
+    }
+
+    static void destroy()
+    {
+
+    }
+
+    static void clear()
+    {
+
+    }
+#endif
+};
+
+
+#endif
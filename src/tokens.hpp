@@ -67,28 +67,57 @@ enum class OperationType
 {
     ADD_MEM,
     ADD_MPTR,
+    ASSIGN_MEM,
+    ASSIGN_MPTR,
     LOOP,
+    SCAN,
+    MUL_ADD,
     PRINT,
+    PRINT_STRING,
     READ,
     FLUSH
 };
 
 
+// tamanhos para células de 8 bits, com CELL_16/CELL_32 os parâmetros que guardam
+// valores de célula (marcados com 'cell') passam a ter 16/32 bits e as somas 'int16 (add)'
+// passam a ter 32 bits com CELL_32
 enum class InstructionSet
 {
-    ADD_MEM,         // tamanho: 3 bytes, params: int16
+    ADD_MEM,         // tamanho: 3 bytes, params: int16 (add)
     ADD_MP,          // tamanho: 3 bytes, params: int16
-    JUMP,            // tamanho: 3 bytes, params: uint16
-    JUMP_IF_EQ,      // tamanho: 4 bytes, params: uint8, uint16
-    JUMP_IF_DIFF,    // tamanho: 4 bytes, params: uint8, uint16
-    ASSIGN_MEM,      // tamanho: 2 bytes, params: uint8
+    JUMP,            // tamanho: 3 bytes, params: uint16 (5 bytes, uint32 com WIDE_JUMPS)
+    JUMP_IF_EQ,      // tamanho: 4 bytes, params: uint8 (cell), uint16 (6 bytes, uint32 com WIDE_JUMPS)
+    JUMP_IF_DIFF,    // tamanho: 4 bytes, params: uint8 (cell), uint16 (6 bytes, uint32 com WIDE_JUMPS)
+    ASSIGN_MEM,      // tamanho: 2 bytes, params: uint8 (cell)
     ASSIGN_MP,       // tamanho: 3 bytes, params: uint16
     READ_CHAR,       // tamanho: 1 byte
     READ_NUM,        // tamanho: 1 byte
     PRINT_NUM,       // tamanho: 1 byte
     PRINT_ASCII,     // tamanho: 1 byte
     FLUSH,           // tamanho: 1 byte
-    END              // tamanho: 1 byte
+    END,             // tamanho: 1 byte
+    SCAN,            // tamanho: 4 bytes, params: uint8 (cell), int16
+    MUL_ADD,         // tamanho: 2 + 3n bytes, params: uint8 n, n * (int16, uint8 (cell))
+    ADD_MEM_OFFSET,  // tamanho: 5 bytes, params: int16 (offset), int16 (add)
+    ASSIGN_MEM_OFFSET, // tamanho: 4 bytes, params: int16 (offset), uint8 (cell)
+    PRINT_STRING     // tamanho: 3 + n bytes, params: uint16 n, n bytes da saída
 };
 
+
+// byte que segue a assinatura "brfk" nos binários,
+// binários antigos têm esse byte sempre em 0
+namespace BinaryFlags
+{
+    enum : uint8_t
+    {
+        WIDE_JUMPS = 1 << 0,    // destinos dos saltos em uint32 em vez de uint16
+        CELL_16    = 1 << 1,    // células de 16 bits
+        CELL_32    = 1 << 2,    // células de 32 bits
+        SNAPSHOT   = 1 << 3,    // estado de 'build --pre-execute' antes do programa ('VirtualMachine::snapshot')
+
+        ALL = WIDE_JUMPS | CELL_16 | CELL_32 | SNAPSHOT
+    };
+}
+
 #endif
\ No newline at end of file
@@ -9,6 +9,7 @@
 #include <cstdint>
 #include <list>
 #include <sstream>
+#include <memory_resource>
 
 class Color
 {
@@ -160,4 +161,24 @@ class ErrorHandler
 };
 
 
-#endif
\ No newline at end of file
+// memória de uma compilação: tokens, colunas de 'Operations' e estruturas dos passes
+// vêm de blocos grandes, devolvidos todos de uma vez quando o 'Arena' é destruído;
+// o que é liberado antes disso volta para 'pool' e é reaproveitado
+class Arena
+{
+    private:
+
+        std::pmr::monotonic_buffer_resource blocks;
+        std::pmr::unsynchronized_pool_resource pool {&this->blocks};
+
+    public:
+
+        [[nodiscard]]
+        std::pmr::memory_resource* resource()
+        {
+            return &this->pool;
+        }
+};
+
+
+#endif
@@ -4,140 +4,1418 @@
 // local
 #include "utils.hpp"
 #include <cstring>
+#include <vector>
+#include <algorithm>
+#include <map>
+#include <optional>
+#include <memory>
+#include <deque>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include "tokens.hpp"
+#include "tape.hpp"
+#include "jit.hpp"
 
+#if defined(__SSE2__) || defined(__AVX2__)
+    #include <immintrin.h>
+#endif
 
+
+// 'goto' computado (labels como valores) é uma extensão do GCC/Clang,
+// nos outros compiladores o modo THREADED cai no 'switch'
+#if defined(__GNUC__) || defined(__clang__)
+    #define BRFK_COMPUTED_GOTO
+#endif
+
+
+enum class DispatchMode
+{
+    SWITCH,
+    THREADED,
+    JIT,
+    TIERED // THREADED, com os loops quentes passando para o JIT
+};
+
+
+// forma interna e de largura fixa de uma instrução, produzida uma única vez
+// a partir do bytecode big-endian do 'brfk' em 'VirtualMachine::load'
+template <typename Cell>
+struct Instruction
+{
+    InstructionSet opcode;
+    Cell cmp;            // JUMP_IF_EQ, JUMP_IF_DIFF, SCAN: valor comparado
+    int16_t offset;      // ADD_MEM_OFFSET, ASSIGN_MEM_OFFSET: célula relativa a 'mp'
+    int32_t operand;     // ADD_MEM, ADD_MP, ASSIGN_MEM, ASSIGN_MP: valor já estendido, SCAN: passo,
+                         // MUL_ADD: índice do primeiro termo em 'VirtualMachine::mul_terms',
+                         // PRINT_STRING: posição do texto em 'VirtualMachine::strings'
+    uint32_t target;     // JUMP, JUMP_IF_EQ, JUMP_IF_DIFF: índice da instrução de destino,
+                         // MUL_ADD: quantidade de termos, PRINT_STRING: tamanho do texto
+};
+
+
+template <typename Cell>
+struct MulTerm
+{
+    int32_t offset;
+    Cell factor;
+};
+
+
+// 'Cell' é o tipo das células da fita (uint8_t, uint16_t ou uint32_t),
+// que precisa ser o mesmo indicado pelas flags CELL_16/CELL_32 do binário
+template <typename Cell>
 struct VirtualMachine
 {
-    uint16_t pc = 0;
-    uint16_t mp = 0;
+    uint32_t pc = 0;
+    intptr_t mp = 0; // 'FixedTape::Index' ou 'GrowableTape::Index', conforme 'tape_mode'
 
     uint8_t* program;
-    uint16_t program_size;
+    uint32_t program_size;
+    uint8_t flags = 0; // 'BinaryFlags' do cabeçalho do binário
+
+    std::vector<Instruction<Cell>> code;
+    std::vector<MulTerm<Cell>> mul_terms;
+    std::string strings; // textos de todos os PRINT_STRING
 
-    uint8_t* mem;
-    static const uint32_t mem_size = UINT16_MAX;
+    TapeMode tape_mode;
+    Cell* mem; // célula 0
 
     std::string bstdout;
     std::string bstdin;
 
-    VirtualMachine()
+    // instrução onde 'load' põe 'pc', diferente de 0 ao retomar um 'BinaryFlags::SNAPSHOT'
+    uint32_t start_pc = 0;
+    size_t flushed = 0; // bytes de 'bstdout' já escritos por FLUSH durante 'pre_execute'
+
+#ifdef BRFK_JIT
+    // código gerado para as instruções de 'first' em diante: lê e atualiza '*mp'
+    // e retorna o índice da instrução onde a VM deve continuar
+    using JitEntry = uint32_t (*)(Cell* mem, intptr_t* mp, VirtualMachine* vm);
+
+    // saltos de volta para um loop até que ele seja compilado no modo TIERED
+    static const uint32_t hot_threshold = 1000;
+
+    ExecutableMemory jit_code; // gerado a partir de 'code', vazio até o primeiro 'run' com JIT
+    uint32_t jit_start = 0;    // instrução por onde 'jit_code' começa
+
+    // modo TIERED, indexados pelo início do corpo do loop (o destino do JUMP_IF_DIFF);
+    // os loops quentes são compilados por 'compiler' enquanto a VM continua
+    // interpretando, que publica o código em 'hot_loops' sem travas
+    std::vector<uint32_t> back_edges;
+    std::unique_ptr<std::atomic<JitEntry>[]> hot_loops;
+    std::vector<std::unique_ptr<ExecutableMemory>> hot_code; // só usado por 'compiler'
+
+    // um loop com desvios no corpo ('[' ']' usados como if) é compilado a partir do
+    // caminho que uma iteração realmente executou: ao ficar quente a VM grava em 'trace'
+    // as instruções da próxima iteração, do início do corpo ao salto de volta
+    bool tracing = false;
+    uint32_t trace_header = 0;
+    uint32_t trace_back_edge = 0;
+    std::vector<uint32_t> trace;
+
+    struct CompileJob
     {
-        this->mem = new uint8_t[this->mem_size];
-        this->clear_memory();
+        uint32_t header;
+        uint32_t back_edge;
+        std::vector<uint32_t> trace; // vazio compila só o intervalo
+    };
+
+    std::thread compiler;
+    std::mutex compile_mutex;
+    std::condition_variable compile_signal;
+    std::deque<CompileJob> compile_queue;
+    bool compiler_stop = false;
+#endif
+
+    VirtualMachine(TapeMode tape_mode = TapeMode::FIXED): tape_mode(tape_mode)
+    {
+        if (this->tape_mode == TapeMode::GROWABLE)
+            this->mem = (Cell*)GrowableTape::create();
+        else
+        {
+            this->mem = new Cell[FixedTape::size];
+            this->clear_memory();
+        }
     }
 
-    void run()
+    ~VirtualMachine()
     {
+#ifdef BRFK_JIT
+        this->stop_compiler();
+#endif
 
-        while (true)
+        if (this->tape_mode == TapeMode::GROWABLE)
+            GrowableTape::destroy();
+        else
+            delete[] this->mem;
+    }
+
+    void run(DispatchMode mode = DispatchMode::THREADED)
+    {
+        if (this->tape_mode == TapeMode::GROWABLE)
+            this->run<GrowableTape>(mode);
+        else
+            this->run<FixedTape>(mode);
+    }
+
+    template <typename Tape>
+    void run(DispatchMode mode)
+    {
+        if (this->code.empty())
+            this->load();
+
+#ifdef BRFK_JIT
+        // sem suporte a alguma instrução o programa é interpretado
+        if (mode == DispatchMode::JIT && this->run_jit<Tape>())
+            return;
+    #ifdef BRFK_COMPUTED_GOTO
+        if (mode == DispatchMode::TIERED)
+        {
+            this->run_threaded<Tape, true>();
+            return;
+        }
+    #endif
+#endif
+
+#ifdef BRFK_COMPUTED_GOTO
+        if (mode != DispatchMode::SWITCH)
+        {
+            this->run_threaded<Tape>();
+            return;
+        }
+#else
+        (void)mode;
+#endif
+        this->run_switch<Tape>();
+    }
+
+    // decodifica 'program' em 'code': operandos são lidos e estendidos
+    // e os destinos dos saltos passam de offsets em bytes para índices,
+    // assim o loop de execução não decodifica nada
+    void load()
+    {
+        const bool wide = this->flags & BinaryFlags::WIDE_JUMPS;
+        const uint8_t cell = sizeof(Cell);
+        const uint8_t add = (sizeof(Cell) == 4) ? 4 : 2;
+        const uint8_t dest = (wide) ? 4 : 2;
+
+        // MUL_ADD e PRINT_STRING têm tamanho variável, calculado a partir do seu primeiro parâmetro
+        const uint8_t inst_size[] =
+        {
+            (uint8_t)(1 + add), 3, (uint8_t)(1 + dest), (uint8_t)(1 + cell + dest), (uint8_t)(1 + cell + dest),
+            (uint8_t)(1 + cell), 3, 1, 1, 1, 1, 1, 1, (uint8_t)(3 + cell), 2, (uint8_t)(3 + add), (uint8_t)(3 + cell), 3
+        };
+
+        std::vector<uint32_t> byte_to_idx(this->program_size + 1, UINT32_MAX);
+        uint32_t count = 0;
+
+        for (uint32_t bi = 0; bi < this->program_size;)
+        {
+            uint8_t op = this->program[bi];
+            if (op > (uint8_t)InstructionSet::PRINT_STRING)
+                panic(std::string {"non-existent instruction: "}.append(std::to_string((int)op)).data());
+            if (bi + inst_size[op] > this->program_size)
+                panic("truncated instruction at the end of the program");
+
+            uint32_t size = inst_size[op];
+            if (op == (uint8_t)InstructionSet::MUL_ADD)
+                size += (2 + cell) * this->program[bi + 1];
+            else if (op == (uint8_t)InstructionSet::PRINT_STRING)
+                size += (this->program[bi + 1] << 8) | this->program[bi + 2];
+            if (bi + size > this->program_size)
+                panic("truncated instruction at the end of the program");
+
+            byte_to_idx[bi] = count++;
+            bi += size;
+        }
+        byte_to_idx[this->program_size] = count;
+
+        this->code.clear();
+        this->code.reserve(count + 1);
+#ifdef BRFK_JIT
+        this->stop_compiler();
+        this->jit_code.release();
+        this->back_edges.assign(count + 1, 0);
+        this->hot_loops = std::make_unique<std::atomic<JitEntry>[]>(count + 1);
+        this->hot_code.clear();
+        this->tracing = false;
+#endif
+        this->mul_terms.clear();
+        this->strings.clear();
+
+        auto resolve = [&](uint32_t& bi) -> uint32_t
+        {
+            uint32_t dest = (wide) ? VirtualMachine::decode<uint32_t>(this->program, bi)
+                                   : VirtualMachine::decode<uint16_t>(this->program, bi);
+
+            if (dest > this->program_size || byte_to_idx[dest] == UINT32_MAX)
+                panic("jump to an invalid destination");
+            return byte_to_idx[dest];
+        };
+
+        // somas têm 16 bits, exceto com células de 32 bits
+        auto decode_add = [&](uint32_t& bi) -> int32_t
+        {
+            return (sizeof(Cell) == 4) ? VirtualMachine::decode<int32_t>(this->program, bi)
+                                       : VirtualMachine::decode<int16_t>(this->program, bi);
+        };
+
+        uint32_t bi = 0;
+        while (bi < this->program_size)
         {
+            Instruction<Cell> inst {(InstructionSet)VirtualMachine::decode<uint8_t>(this->program, bi), 0, 0, 0, 0};
 
-            InstructionSet inst = (InstructionSet)(this->read_program<uint8_t>()); 
-        
-            switch (inst)
+            switch (inst.opcode)
             {
                 case InstructionSet::ADD_MEM:
                 {
-                    this->mem[this->mp] += this->read_program<int16_t>();
+                    inst.operand = decode_add(bi);
                     break;
                 }
                 case InstructionSet::ADD_MP:
                 {
-                    this->mp += this->read_program<int16_t>();
+                    inst.operand = VirtualMachine::decode<int16_t>(this->program, bi);
                     break;
                 }
                 case InstructionSet::JUMP:
                 {
-                    uint16_t loc = this->read_program<uint16_t>();
-                    this->pc = loc;
+                    inst.target = resolve(bi);
                     break;
                 }
                 case InstructionSet::JUMP_IF_EQ:
+                case InstructionSet::JUMP_IF_DIFF:
                 {
-                    uint8_t val = this->read_program<uint8_t>();
-                    uint16_t loc = this->read_program<uint16_t>();
-                    if (val == this->mem[this->mp])
-                    {
-                        this->pc = loc;
-                    } 
+                    inst.cmp = VirtualMachine::decode<Cell>(this->program, bi);
+                    inst.target = resolve(bi);
                     break;
                 }
-                case InstructionSet::JUMP_IF_DIFF:
+                case InstructionSet::ASSIGN_MEM:
+                {
+                    inst.operand = VirtualMachine::decode<Cell>(this->program, bi);
+                    break;
+                }
+                case InstructionSet::ASSIGN_MP:
                 {
-                    uint8_t val = this->read_program<uint8_t>();
-                    uint16_t loc = this->read_program<uint16_t>();
-                    if (val != this->mem[this->mp])
+                    inst.operand = VirtualMachine::decode<uint16_t>(this->program, bi);
+                    break;
+                }
+                case InstructionSet::SCAN:
+                {
+                    inst.cmp = VirtualMachine::decode<Cell>(this->program, bi);
+                    inst.operand = VirtualMachine::decode<int16_t>(this->program, bi);
+                    break;
+                }
+                case InstructionSet::ADD_MEM_OFFSET:
+                {
+                    inst.offset = VirtualMachine::decode<int16_t>(this->program, bi);
+                    inst.operand = decode_add(bi);
+                    break;
+                }
+                case InstructionSet::ASSIGN_MEM_OFFSET:
+                {
+                    inst.offset = VirtualMachine::decode<int16_t>(this->program, bi);
+                    inst.operand = VirtualMachine::decode<Cell>(this->program, bi);
+                    break;
+                }
+                case InstructionSet::MUL_ADD:
+                {
+                    inst.operand = this->mul_terms.size();
+                    inst.target = VirtualMachine::decode<uint8_t>(this->program, bi);
+
+                    for (uint32_t i = 0; i < inst.target; i++)
                     {
-                        this->pc = loc;
+                        int16_t offset = VirtualMachine::decode<int16_t>(this->program, bi);
+                        Cell factor = VirtualMachine::decode<Cell>(this->program, bi);
+                        this->mul_terms.push_back(MulTerm<Cell> {offset, factor});
                     }
                     break;
                 }
+                case InstructionSet::PRINT_STRING:
+                {
+                    inst.operand = this->strings.size();
+                    inst.target = VirtualMachine::decode<uint16_t>(this->program, bi);
+                    this->strings.append((const char*)this->program + bi, inst.target);
+                    bi += inst.target;
+                    break;
+                }
+                default:
+                    break;
+            }
+
+            this->code.push_back(inst);
+        }
+
+        // sentinela, um salto para o fim do programa ou um programa
+        // sem END nunca executa além do vetor
+        this->code.push_back(Instruction<Cell> {InstructionSet::END, 0, 0, 0, 0});
+
+        if (this->start_pc >= this->code.size())
+            panic("snapshot resumes outside of the program");
+        this->pc = this->start_pc;
+    }
+
+    // com 'Prefix' ('pre_execute') a execução para antes da primeira leitura ou depois de
+    // 'budget' instruções, e FLUSH só marca a saída como escrita em 'flushed'
+    template <typename Tape, bool Prefix = false>
+    void run_switch(uint64_t budget = 0)
+    {
+        const Instruction<Cell>* const code = this->code.data();
+        const MulTerm<Cell>* const mul_terms = this->mul_terms.data();
+        Cell* const mem = this->mem;
+        uint32_t pc = this->pc;
+        typename Tape::Index mp = this->mp;
+
+        while (true)
+        {
+            const Instruction<Cell>& inst = code[pc];
+
+            if constexpr (Prefix)
+            {
+                if (budget-- == 0 || inst.opcode == InstructionSet::READ_CHAR || inst.opcode == InstructionSet::READ_NUM)
+                    goto fim;
+            }
+
+            switch (inst.opcode)
+            {
+                case InstructionSet::ADD_MEM:
+                {
+                    mem[mp] += inst.operand;
+                    pc++;
+                    break;
+                }
+                case InstructionSet::ADD_MP:
+                {
+                    mp += inst.operand;
+                    pc++;
+                    break;
+                }
+                case InstructionSet::JUMP:
+                {
+                    pc = inst.target;
+                    break;
+                }
+                case InstructionSet::JUMP_IF_EQ:
+                {
+                    pc = (inst.cmp == mem[mp]) ? inst.target : pc + 1;
+                    break;
+                }
+                case InstructionSet::JUMP_IF_DIFF:
+                {
+                    pc = (inst.cmp != mem[mp]) ? inst.target : pc + 1;
+                    break;
+                }
                 case InstructionSet::ASSIGN_MEM:
                 {
-                    this->mem[this->mp] = this->read_program<uint8_t>();
+                    mem[mp] = inst.operand;
+                    pc++;
                     break;
                 }
                 case InstructionSet::ASSIGN_MP:
                 {
-                    this->mp = this->read_program<uint16_t>();
+                    mp = Tape::assign(inst.operand);
+                    pc++;
                     break;
                 }
                 case InstructionSet::READ_CHAR:
                 {
-                    this->mem[this->mp] = this->read_ch();
+                    mem[mp] = (uint8_t)this->read_ch();
+                    pc++;
                     break;
                 }
                 case InstructionSet::READ_NUM:
                 {
-                    this->mem[this->mp] = this->read_num();
+                    mem[mp] = this->read_num();
+                    pc++;
                     break;
                 }
                 case InstructionSet::PRINT_NUM:
                 {
-                    this->bstdout.append(std::to_string(this->mem[this->mp]));
+                    this->bstdout.append(std::to_string(mem[mp]));
+                    pc++;
                     break;
                 }
                 case InstructionSet::PRINT_ASCII:
                 {
-                    this->bstdout.push_back(this->mem[this->mp]);
+                    this->bstdout.push_back((char)mem[mp]);
+                    pc++;
                     break;
                 }
                 case InstructionSet::FLUSH:
                 {
-                    std::cout << this->bstdout << std::flush;
-                    this->bstdout.clear();
+                    if constexpr (Prefix)
+                        this->flushed = this->bstdout.size();
+                    else
+                    {
+                        std::cout << this->bstdout << std::flush;
+                        this->bstdout.clear();
+                    }
+                    pc++;
+                    break;
+                }
+                case InstructionSet::SCAN:
+                {
+                    mp = VirtualMachine::scan<Tape>(mem, mp, inst.cmp, inst.operand);
+                    pc++;
+                    break;
+                }
+                case InstructionSet::MUL_ADD:
+                {
+                    VirtualMachine::mul_add<Tape>(mem, mp, mul_terms + inst.operand, inst.target);
+                    pc++;
+                    break;
+                }
+                case InstructionSet::ADD_MEM_OFFSET:
+                {
+                    mem[Tape::at(mp, inst.offset)] += inst.operand;
+                    pc++;
+                    break;
+                }
+                case InstructionSet::ASSIGN_MEM_OFFSET:
+                {
+                    mem[Tape::at(mp, inst.offset)] = inst.operand;
+                    pc++;
+                    break;
+                }
+                case InstructionSet::PRINT_STRING:
+                {
+                    this->bstdout.append(this->strings, inst.operand, inst.target);
+                    pc++;
                     break;
                 }
                 case InstructionSet::END:
                 {
                     goto fim;
                 }
+            }
+        }
+        fim:;
+
+        this->pc = pc;
+        this->mp = mp;
+    }
+
+#ifdef BRFK_COMPUTED_GOTO
+    // cada handler termina com o seu próprio salto indireto (DISPATCH),
+    // o que dá ao preditor de desvios um histórico por instrução
+    // em vez de um único salto compartilhado como no 'switch'
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wpedantic"
+    // com 'Profile' os saltos de volta são contados e os loops quentes executados pelo JIT
+    template <typename Tape, bool Profile = false>
+    void run_threaded()
+    {
+        static void* const dispatch_table[] =
+        {
+            &&add_mem,
+            &&add_mp,
+            &&jump,
+            &&jump_if_eq,
+            &&jump_if_diff,
+            &&assign_mem,
+            &&assign_mp,
+            &&read_char,
+            &&read_num,
+            &&print_num,
+            &&print_ascii,
+            &&flush,
+            &&end,
+            &&scan,
+            &&mul_add,
+            &&add_mem_offset,
+            &&assign_mem_offset,
+            &&print_string
+        };
+
+#ifdef BRFK_JIT
+        // usada enquanto um traço é gravado, toda instrução passa por 'record'
+        static void* const record_table[] =
+        {
+            &&record, &&record, &&record, &&record, &&record, &&record,
+            &&record, &&record, &&record, &&record, &&record, &&record,
+            &&record, &&record, &&record, &&record, &&record, &&record
+        };
+#endif
+
+        // pc, mp e os ponteiros ficam em variáveis locais para que o compilador
+        // possa mantê-los em registradores, escritas em 'mem' (uint8_t, com células de 8 bits)
+        // podem ser alias de qualquer membro e forçariam recarregá-los a cada instrução
+        const Instruction<Cell>* const code = this->code.data();
+        const Instruction<Cell>* ip = code + this->pc;
+        const MulTerm<Cell>* const mul_terms = this->mul_terms.data();
+        Cell* const mem = this->mem;
+        typename Tape::Index mp = this->mp;
+
+        void* const* table = dispatch_table;
+
+        #define DISPATCH() goto *table[(uint8_t)ip->opcode]
+
+        DISPATCH();
+
+        add_mem:
+        {
+            mem[mp] += ip->operand;
+            ip++;
+            DISPATCH();
+        }
+        add_mp:
+        {
+            mp += ip->operand;
+            ip++;
+            DISPATCH();
+        }
+        jump:
+        {
+            ip = code + ip->target;
+            DISPATCH();
+        }
+        jump_if_eq:
+        {
+            ip = (ip->cmp == mem[mp]) ? code + ip->target : ip + 1;
+            DISPATCH();
+        }
+        jump_if_diff:
+        {
+#ifdef BRFK_JIT
+            if constexpr (Profile)
+            {
+                if (ip->cmp != mem[mp] && this->tracing)
+                {
+                    // fim da iteração gravada ou um loop interno que repete
+                    this->end_trace<Tape>(ip - code);
+                    table = dispatch_table;
+                }
+                else if (ip->cmp != mem[mp])
+                {
+                    // entra no código do loop pelo início do corpo, para onde o salto iria
+                    JitEntry loop = this->profile<Tape>(ip->target, ip - code);
+                    if (loop != nullptr)
+                    {
+                        intptr_t loop_mp = mp;
+                        ip = code + loop(mem, &loop_mp, this);
+                        mp = loop_mp;
+                        DISPATCH();
+                    }
+                    if (this->tracing)
+                        table = record_table;
+                }
+            }
+#endif
+            ip = (ip->cmp != mem[mp]) ? code + ip->target : ip + 1;
+            DISPATCH();
+        }
+        assign_mem:
+        {
+            mem[mp] = ip->operand;
+            ip++;
+            DISPATCH();
+        }
+        assign_mp:
+        {
+            mp = Tape::assign(ip->operand);
+            ip++;
+            DISPATCH();
+        }
+        read_char:
+        {
+            mem[mp] = (uint8_t)this->read_ch();
+            ip++;
+            DISPATCH();
+        }
+        read_num:
+        {
+            mem[mp] = this->read_num();
+            ip++;
+            DISPATCH();
+        }
+        print_num:
+        {
+            this->bstdout.append(std::to_string(mem[mp]));
+            ip++;
+            DISPATCH();
+        }
+        print_ascii:
+        {
+            this->bstdout.push_back((char)mem[mp]);
+            ip++;
+            DISPATCH();
+        }
+        flush:
+        {
+            std::cout << this->bstdout << std::flush;
+            this->bstdout.clear();
+            ip++;
+            DISPATCH();
+        }
+        scan:
+        {
+            mp = VirtualMachine::scan<Tape>(mem, mp, ip->cmp, ip->operand);
+            ip++;
+            DISPATCH();
+        }
+        mul_add:
+        {
+            VirtualMachine::mul_add<Tape>(mem, mp, mul_terms + ip->operand, ip->target);
+            ip++;
+            DISPATCH();
+        }
+        add_mem_offset:
+        {
+            mem[Tape::at(mp, ip->offset)] += ip->operand;
+            ip++;
+            DISPATCH();
+        }
+        assign_mem_offset:
+        {
+            mem[Tape::at(mp, ip->offset)] = ip->operand;
+            ip++;
+            DISPATCH();
+        }
+        print_string:
+        {
+            this->bstdout.append(this->strings, ip->operand, ip->target);
+            ip++;
+            DISPATCH();
+        }
+#ifdef BRFK_JIT
+        record:
+        {
+            if constexpr (Profile)
+            {
+                if (!this->record<Tape>(ip - code))
+                    table = dispatch_table;
+            }
+            goto *dispatch_table[(uint8_t)ip->opcode];
+        }
+#endif
+        end:;
+
+        this->pc = ip - code;
+        this->mp = mp;
+
+        #undef DISPATCH
+    }
+    #pragma GCC diagnostic pop
+#endif
+
+#ifdef BRFK_JIT
+    // executa o programa traduzido para x86-64, retorna false
+    // caso ele não possa ser traduzido e precise ser interpretado
+    template <typename Tape>
+    bool run_jit()
+    {
+        // o código gerado começa pela instrução onde a VM estava ao compilá-lo
+        if (this->jit_code.data == nullptr)
+        {
+            this->jit_start = this->pc;
+            if (!this->jit_compile<Tape>(0, this->code.size() - 1, this->jit_code, {}, this->pc))
+                return false;
+        }
+        if (this->pc != this->jit_start)
+            return false;
+
+        this->pc = ((JitEntry)this->jit_code.data)(this->mem, &this->mp, this);
+        return true;
+    }
+
+    // conta um salto de volta de 'back_edge' para 'header', retorna o código
+    // do loop caso ele já tenha sido compilado
+    template <typename Tape>
+    JitEntry profile(uint32_t header, uint32_t back_edge)
+    {
+        JitEntry loop = this->hot_loops[header].load(std::memory_order_acquire);
+        if (loop != nullptr)
+            return loop;
+
+        // cada loop é enviado ao compilador uma única vez, os que têm
+        // desvios no corpo depois de gravar uma iteração
+        if (++this->back_edges[header] == hot_threshold)
+        {
+            if (!this->tracing && this->branchy(header, back_edge))
+            {
+                this->tracing = true;
+                this->trace_header = header;
+                this->trace_back_edge = back_edge;
+                this->trace.clear();
+            }
+            else
+                this->enqueue<Tape>({header, back_edge, {}});
+        }
+        return nullptr;
+    }
+
+    bool branchy(uint32_t header, uint32_t back_edge) const
+    {
+        for (uint32_t i = header; i < back_edge; i++)
+        {
+            InstructionSet opcode = this->code[i].opcode;
+            if (opcode == InstructionSet::JUMP_IF_EQ || opcode == InstructionSet::JUMP_IF_DIFF)
+                return true;
+        }
+        return false;
+    }
+
+    // grava a instrução 'i' no traço, retorna false ao abandoná-lo quando a execução
+    // sai do loop ou repete uma instrução (um JUMP de volta) antes do salto de volta
+    template <typename Tape>
+    bool record(uint32_t i)
+    {
+        uint32_t length = this->trace_back_edge - this->trace_header + 1;
+        if (i >= this->trace_header && i <= this->trace_back_edge && this->trace.size() < length)
+        {
+            this->trace.push_back(i);
+            return true;
+        }
+
+        this->tracing = false;
+        this->enqueue<Tape>({this->trace_header, this->trace_back_edge, {}});
+        return false;
+    }
+
+    // salto de volta tomado em 'back_edge' durante a gravação: o do próprio loop
+    // completa o traço, o de um loop interno (que não é um if) o descarta
+    template <typename Tape>
+    void end_trace(uint32_t back_edge)
+    {
+        this->tracing = false;
+        if (back_edge == this->trace_back_edge)
+            this->enqueue<Tape>({this->trace_header, back_edge, std::move(this->trace)});
+        else
+            this->enqueue<Tape>({this->trace_header, this->trace_back_edge, {}});
+    }
+
+    template <typename Tape>
+    void enqueue(CompileJob job)
+    {
+        {
+            std::lock_guard<std::mutex> lock {this->compile_mutex};
+            this->compile_queue.push_back(std::move(job));
+        }
+
+        if (!this->compiler.joinable())
+            this->compiler = std::thread {&VirtualMachine::compile_loops<Tape>, this};
+        this->compile_signal.notify_one();
+    }
+
+    // corpo da thread 'compiler', 'code' não muda enquanto ela existe
+    template <typename Tape>
+    void compile_loops()
+    {
+        std::unique_lock<std::mutex> lock {this->compile_mutex};
+
+        while (true)
+        {
+            this->compile_signal.wait(lock, [this] {return this->compiler_stop || !this->compile_queue.empty();});
+            if (this->compiler_stop)
+                return;
+
+            CompileJob job = std::move(this->compile_queue.front());
+            this->compile_queue.pop_front();
+            lock.unlock();
+
+            // um loop que não pode ser compilado continua sendo interpretado
+            std::unique_ptr<ExecutableMemory> loop = std::make_unique<ExecutableMemory>();
+            if (this->jit_compile<Tape>(job.header, job.back_edge, *loop, job.trace))
+            {
+                this->hot_loops[job.header].store((JitEntry)loop->data, std::memory_order_release);
+                this->hot_code.push_back(std::move(loop));
+            }
+
+            lock.lock();
+        }
+    }
+
+    void stop_compiler()
+    {
+        if (!this->compiler.joinable())
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock {this->compile_mutex};
+            this->compiler_stop = true;
+        }
+        this->compile_signal.notify_one();
+        this->compiler.join();
+
+        this->compiler_stop = false;
+        this->compile_queue.clear();
+    }
+
+    // gera em 'out' uma função 'JitEntry' para as instruções de 'first' a 'last'
+    // (começando por 'trace', se houver, ou por 'entry'), que chama de volta a VM para E/S
+    template <typename Tape>
+    bool jit_compile(uint32_t first, uint32_t last, ExecutableMemory& out, const std::vector<uint32_t>& trace = {}, uint32_t entry = 0)
+    {
+        using namespace x64;
+
+        Assembler as;
+
+        auto io = [&](InstructionSet opcode)
+        {
+            uintptr_t function = 0;
+            if (opcode == InstructionSet::READ_CHAR)
+                function = reinterpret_cast<uintptr_t>(&VirtualMachine::jit_read_char);
+            else if (opcode == InstructionSet::READ_NUM)
+                function = reinterpret_cast<uintptr_t>(&VirtualMachine::jit_read_num);
+            else if (opcode == InstructionSet::PRINT_NUM)
+                function = reinterpret_cast<uintptr_t>(&VirtualMachine::jit_print_num);
+            else if (opcode == InstructionSet::PRINT_ASCII)
+                function = reinterpret_cast<uintptr_t>(&VirtualMachine::jit_print_ascii);
+            else
+                function = reinterpret_cast<uintptr_t>(&VirtualMachine::jit_flush);
+
+            as.mov(RDI, R13, 8);
+            as.mov(RSI, R14, 4);
+            as.mov64(RAX, function);
+            as.call(RAX);
+        };
+
+        // r15 guarda o ponteiro para 'mp' e mantém a pilha alinhada em 16 bytes nas chamadas
+        as.push(RBX);
+        as.push(R12);
+        as.push(R13);
+        as.push(R14);
+        as.push(R15);
+        as.mov(RBX, RDI, 8);
+        as.mov(R15, RSI, 8);
+        as.mov(R13, RDX, 8);
+        as.mov(R12, Mem {R15, RSP, 1}, 8);
+
+        if (!this->emit_x64<Tape>(as, io, first, last, trace, entry))
+            return false;
+
+        as.mov(Mem {R15, RSP, 1}, R12, 8);
+        as.pop(R15);
+        as.pop(R14);
+        as.pop(R13);
+        as.pop(R12);
+        as.pop(RBX);
+        as.ret();
+
+        return out.load(as.code);
+    }
+#endif
+
+    // traduz as instruções de 'first' a 'last' para x86-64 em 'as', com os registradores fixos
+    // rbx = 'mem', r12 = 'mp' e r14 = valor de mem[mp] estendido com zeros; a célula atual só
+    // é escrita na memória quando 'mp' muda ou o código termina, assim a maior parte das
+    // instruções não acessa a memória. 'io(opcode)' emite a chamada de cada instrução de E/S,
+    // com a célula em r14 e, nas leituras, o resultado em eax. O código começa em 'first' e,
+    // ao saltar para fora do intervalo, passar de 'last' ou chegar a um END, segue para o fim
+    // do que foi emitido com 'mp' em r12 e em eax o índice da instrução onde a execução
+    // continua (o próprio END). rbx e r12 são preenchidos pelo chamador.
+    // Com 'trace' (índices executados em uma iteração do loop 'first'..'last', a partir do
+    // início do corpo) o código começa pelo traço em linha reta, cada salto condicional vira uma
+    // guarda que desvia para a cópia do intervalo quando a direção não é a gravada, e o
+    // salto de volta do intervalo retorna ao início do traço. Sem traço, um 'entry' depois
+    // de 'first' faz o código começar por ele (a retomada de um snapshot)
+    template <typename Tape, typename Io>
+    bool emit_x64(Assembler& as, Io io, uint32_t first, uint32_t last, const std::vector<uint32_t>& trace = {}, uint32_t entry = 0) const
+    {
+        using namespace x64;
+
+        const uint8_t cell = sizeof(Cell);
+        const Mem current {RBX, R12, cell};
+
+        std::vector<uint32_t> labels(last - first + 1);
+        std::vector<std::pair<uint32_t, uint32_t>> fixups; // deslocamento a preencher, índice do destino
+        std::map<uint32_t, std::vector<uint32_t>> exits;   // índice onde a execução continua, deslocamentos
+
+        auto jump = [&](uint32_t at, uint32_t target)
+        {
+            if (target >= first && target <= last)
+                fixups.push_back({at, target});
+            else
+                exits[target].push_back(at);
+        };
+
+        as.movzx(R14, current, cell);
+
+        if (trace.empty() && entry > first)
+            jump(as.jmp(), entry);
+
+        // no traço o valor da célula atual fica conhecido depois de atribuições e guardas,
+        // e os desvios que ele já decide não precisam de guarda ('known' só vale com 'known_valid')
+        bool known_valid = false;
+        Cell known = 0;
+
+        uint32_t trace_start = as.size();
+        for (size_t k = 0; k < trace.size(); k++)
+        {
+            uint32_t i = trace[k];
+            uint32_t next = (k + 1 < trace.size()) ? trace[k + 1] : trace[0];
+            const Instruction<Cell>& inst = this->code[i];
+
+            switch (inst.opcode)
+            {
+                case InstructionSet::JUMP:
+                    break;
+                case InstructionSet::JUMP_IF_EQ:
+                case InstructionSet::JUMP_IF_DIFF:
+                {
+                    bool eq = inst.opcode == InstructionSet::JUMP_IF_EQ;
+                    bool taken = next == inst.target;
+
+                    if (inst.target == i + 1)
+                        break;
+                    if (known_valid && (eq == (known == inst.cmp)) == taken)
+                        break;
+
+                    as.cmp(R14, inst.cmp, 4);
+                    if (taken)
+                        jump(as.jcc(eq ? NE : EQ), i + 1);
+                    else
+                        jump(as.jcc(eq ? EQ : NE), inst.target);
+
+                    if (eq == taken)
+                    {
+                        known = inst.cmp;
+                        known_valid = true;
+                    }
+                    break;
+                }
+                default:
+                {
+                    if (!this->emit_instruction<Tape>(as, io, inst))
+                        return false;
+
+                    if (inst.opcode == InstructionSet::ASSIGN_MEM || (inst.opcode == InstructionSet::ASSIGN_MEM_OFFSET && inst.offset == 0))
+                    {
+                        known = (Cell)inst.operand;
+                        known_valid = true;
+                    }
+                    else if (inst.opcode == InstructionSet::ADD_MEM || (inst.opcode == InstructionSet::ADD_MEM_OFFSET && inst.offset == 0))
+                        known = (Cell)(known + inst.operand);
+                    else if (inst.opcode == InstructionSet::SCAN)
+                    {
+                        known = inst.cmp;
+                        known_valid = true;
+                    }
+                    else if (inst.opcode != InstructionSet::PRINT_NUM && inst.opcode != InstructionSet::PRINT_ASCII &&
+                             inst.opcode != InstructionSet::PRINT_STRING && inst.opcode != InstructionSet::FLUSH &&
+                             inst.opcode != InstructionSet::ADD_MEM_OFFSET && inst.opcode != InstructionSet::ASSIGN_MEM_OFFSET)
+                        known_valid = false;
+                }
+            }
+        }
+        if (!trace.empty())
+            as.patch(as.jmp(), trace_start);
+
+        for (uint32_t i = first; i <= last; i++)
+        {
+            const Instruction<Cell>& inst = this->code[i];
+            labels[i - first] = as.size();
 
+            switch (inst.opcode)
+            {
+                case InstructionSet::JUMP:
+                {
+                    jump(as.jmp(), inst.target);
+                    break;
+                }
+                case InstructionSet::JUMP_IF_EQ:
+                {
+                    as.cmp(R14, inst.cmp, 4);
+                    jump(as.jcc(EQ), inst.target);
+                    break;
+                }
+                case InstructionSet::JUMP_IF_DIFF:
+                {
+                    as.cmp(R14, inst.cmp, 4);
+                    jump(as.jcc(NE), inst.target);
+                    break;
+                }
+                case InstructionSet::END:
+                {
+                    exits[i].push_back(as.jmp());
+                    break;
+                }
                 default:
                 {
-                    panic(std::string {"non-existent instruction: "}.append(std::to_string((int)inst)).data());
+                    if (!this->emit_instruction<Tape>(as, io, inst))
+                        return false;
                 }
+            }
+        }
+
+        exits[last + 1].push_back(as.jmp());
+
+        // uma saída por destino, todas terminam no fim do código
+        std::vector<uint32_t> to_end;
+        for (const auto& [target, jumps] : exits)
+        {
+            for (uint32_t at: jumps)
+                as.patch(at, as.size());
+
+            as.mov(RAX, target, 4);
+            to_end.push_back(as.jmp());
+        }
+
+        for (uint32_t at: to_end)
+            as.patch(at, as.size());
+        as.mov(current, R14, cell);
+
+        if (!trace.empty())
+            labels[trace[0] - first] = trace_start;
+        for (auto [at, target] : fixups)
+            as.patch(at, labels[target - first]);
+
+        return true;
+    }
 
+    // emite uma instrução que não desvia, saltos e END ficam com 'emit_x64'
+    template <typename Tape, typename Io>
+    bool emit_instruction(Assembler& as, Io& io, const Instruction<Cell>& inst) const
+    {
+        using namespace x64;
+
+        const uint8_t cell = sizeof(Cell);
+        const uint8_t index = sizeof(typename Tape::Index);
+        const Mem current {RBX, R12, cell};
+
+        auto move_mp = [&](int32_t amount)
+        {
+            as.add(R12, amount, index);
+        };
+
+        // endereço de uma célula relativa a 'mp', igual a 'Tape::at'
+        auto address = [&](int32_t offset) -> Mem
+        {
+            if (index == 2)
+            {
+                as.lea(RAX, R12, offset, 4);
+                as.movzx(RAX, RAX, 2);
+            }
+            else
+                as.lea(RAX, R12, offset, 8);
+
+            return Mem {RBX, RAX, cell};
+        };
+
+        switch (inst.opcode)
+        {
+            case InstructionSet::ADD_MEM:
+            {
+                as.add(R14, inst.operand, cell);
+                break;
+            }
+            case InstructionSet::ADD_MP:
+            {
+                as.mov(current, R14, cell);
+                move_mp(inst.operand);
+                as.movzx(R14, current, cell);
+                break;
+            }
+            case InstructionSet::ASSIGN_MEM:
+            {
+                as.mov(R14, (Cell)inst.operand, 4);
+                break;
+            }
+            case InstructionSet::ASSIGN_MP:
+            {
+                as.mov(current, R14, cell);
+                as.mov(R12, Tape::assign(inst.operand), 8);
+                as.movzx(R14, current, cell);
+                break;
+            }
+            case InstructionSet::READ_CHAR:
+            {
+                io(inst.opcode);
+                as.movzx(R14, RAX, cell);
+                break;
+            }
+            case InstructionSet::READ_NUM:
+            {
+                io(inst.opcode);
+                as.movzx(R14, RAX, cell);
+                break;
+            }
+            case InstructionSet::PRINT_NUM:
+            {
+                io(inst.opcode);
+                break;
+            }
+            case InstructionSet::PRINT_ASCII:
+            {
+                io(inst.opcode);
+                break;
+            }
+            case InstructionSet::PRINT_STRING:
+            {
+                // cada caractere passa por r14 como em um PRINT_ASCII
+                as.mov(current, R14, cell);
+                for (uint32_t i = 0; i < inst.target; i++)
+                {
+                    as.mov(R14, (uint8_t)this->strings[inst.operand + i], 4);
+                    io(InstructionSet::PRINT_ASCII);
+                }
+                as.movzx(R14, current, cell);
+                break;
             }
-        
+            case InstructionSet::FLUSH:
+            {
+                io(inst.opcode);
+                break;
+            }
+            case InstructionSet::SCAN:
+            {
+                as.mov(current, R14, cell);
+
+                uint32_t loop = as.size();
+                as.cmp(R14, inst.cmp, 4);
+                uint32_t found = as.jcc(EQ);
+                move_mp(inst.operand);
+                as.movzx(R14, current, cell);
+                as.patch(as.jmp(), loop);
+                as.patch(found, as.size());
+                break;
+            }
+            case InstructionSet::MUL_ADD:
+            {
+                as.test(R14, R14, 4);
+                uint32_t skip = as.jcc(EQ);
+
+                // termos na própria célula mudam o contador, ficam para o fim
+                const MulTerm<Cell>* terms = this->mul_terms.data() + inst.operand;
+                for (uint32_t t = 0; t < inst.target; t++)
+                {
+                    if (terms[t].offset == 0)
+                        continue;
+                    as.imul(RCX, R14, terms[t].factor);
+                    as.add(address(terms[t].offset), RCX, cell);
+                }
+                for (uint32_t t = 0; t < inst.target; t++)
+                {
+                    if (terms[t].offset != 0)
+                        continue;
+                    as.imul(RCX, R14, terms[t].factor);
+                    as.add(R14, RCX, cell);
+                }
+
+                as.patch(skip, as.size());
+                break;
+            }
+            case InstructionSet::ADD_MEM_OFFSET:
+            {
+                if (inst.offset == 0)
+                    as.add(R14, inst.operand, cell);
+                else
+                    as.add(address(inst.offset), inst.operand, cell);
+                break;
+            }
+            case InstructionSet::ASSIGN_MEM_OFFSET:
+            {
+                if (inst.offset == 0)
+                    as.mov(R14, (Cell)inst.operand, 4);
+                else
+                    as.mov(address(inst.offset), inst.operand, cell);
+                break;
+            }
+            default:
+                return false;
         }
-        fim:;
 
+        return true;
+    }
+
+#ifdef BRFK_JIT
+
+    // chamadas feitas pelo código gerado, 'value' é a célula atual
+    static void jit_print_num(VirtualMachine* vm, Cell value)
+    {
+        vm->bstdout.append(std::to_string(value));
+    }
+
+    static void jit_print_ascii(VirtualMachine* vm, Cell value)
+    {
+        vm->bstdout.push_back((char)value);
+    }
+
+    static void jit_flush(VirtualMachine* vm)
+    {
+        std::cout << vm->bstdout << std::flush;
+        vm->bstdout.clear();
+    }
+
+    static Cell jit_read_char(VirtualMachine* vm)
+    {
+        return (uint8_t)vm->read_ch();
+    }
+
+    static Cell jit_read_num(VirtualMachine* vm)
+    {
+        return vm->read_num();
+    }
+#endif
+
+    template <typename Tape>
+    static inline void mul_add(Cell* mem, typename Tape::Index mp, const MulTerm<Cell>* terms, uint32_t count)
+    {
+        Cell counter = mem[mp];
+        if (counter == 0)
+            return;
+
+        for (uint32_t i = 0; i < count; i++)
+            mem[Tape::at(mp, terms[i].offset)] += counter * terms[i].factor;
+    }
+
+    // executa um SCAN: a partir de 'mp', anda de 'stride' em 'stride' células
+    // (dando a volta na fita como o próprio 'mp', se ela der a volta) até achar uma igual a 'value'
+    template <typename Tape>
+    static typename Tape::Index scan(const Cell* mem, typename Tape::Index mp, Cell value, int32_t stride)
+    {
+        const intptr_t begin = Tape::template begin<Cell>();
+        const intptr_t end = Tape::template end<Cell>();
+        intptr_t pos = mp;
+
+        // assim como o loop original, não termina se nenhuma célula alcançável for igual a 'value'
+        while (true)
+        {
+            if (stride > 0)
+            {
+                pos = VirtualMachine::scan_forward(mem, pos, end, value, stride);
+                if (pos < end)
+                    return pos;
+                pos -= end - begin;
+            }
+            else
+            {
+                pos = VirtualMachine::scan_backward(mem, pos, begin, value, -stride);
+                if (pos >= begin)
+                    return pos;
+                pos += end - begin;
+            }
+
+            if (!Tape::wraps)
+                panic("tape exhausted");
+        }
+    }
+
+#if defined(__AVX2__)
+    static const int32_t vector_size = 32;
+
+    // movemask com os bytes de 'value' iguais, a partir de 'cells'
+    static inline uint32_t compare(const Cell* cells, Cell value)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)cells);
+        if constexpr (sizeof(Cell) == 1)
+            return _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(value)));
+        else if constexpr (sizeof(Cell) == 2)
+            return _mm256_movemask_epi8(_mm256_cmpeq_epi16(chunk, _mm256_set1_epi16(value)));
+        else
+            return _mm256_movemask_epi8(_mm256_cmpeq_epi32(chunk, _mm256_set1_epi32(value)));
+    }
+#elif defined(__SSE2__)
+    static const int32_t vector_size = 16;
+
+    static inline uint32_t compare(const Cell* cells, Cell value)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)cells);
+        if constexpr (sizeof(Cell) == 1)
+            return _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(value)));
+        else if constexpr (sizeof(Cell) == 2)
+            return _mm_movemask_epi8(_mm_cmpeq_epi16(chunk, _mm_set1_epi16(value)));
+        else
+            return _mm_movemask_epi8(_mm_cmpeq_epi32(chunk, _mm_set1_epi32(value)));
+    }
+#endif
+
+    // retorna a posição encontrada ou, caso alcance o fim da fita,
+    // a primeira posição depois dele
+    static intptr_t scan_forward(const Cell* mem, intptr_t pos, intptr_t end, Cell value, int32_t stride)
+    {
+        if constexpr (sizeof(Cell) == 1)
+        {
+            if (stride == 1)
+            {
+                const void* found = memchr(mem + pos, value, end - pos);
+                return (found) ? (const Cell*)found - mem : end;
+            }
+        }
+
+#if defined(__AVX2__) || defined(__SSE2__)
+        const int32_t cell = sizeof(Cell);
+        const int32_t lanes = vector_size / cell;
+        if (stride < lanes)
+        {
+            // a célula 'i' do vetor corresponde ao bit 'i * cell' da máscara
+            uint32_t mask = 0, step = 0;
+            for (int32_t i = 0; i < lanes; i += stride, step += stride)
+                mask |= 1u << (i * cell);
+
+            for (; pos + lanes <= end; pos += step)
+            {
+                uint32_t hits = VirtualMachine::compare(mem + pos, value) & mask;
+                if (hits)
+                    return pos + __builtin_ctz(hits) / cell;
+            }
+        }
+#endif
+
+        for (; pos < end; pos += stride)
+        {
+            if (mem[pos] == value)
+                return pos;
+        }
+        return pos;
+    }
+
+    // igual a 'scan_forward', mas em direção ao início, retorna
+    // uma posição menor que 'begin' caso passe do começo da fita
+    static intptr_t scan_backward(const Cell* mem, intptr_t pos, intptr_t begin, Cell value, int32_t stride)
+    {
+#ifdef __GLIBC__
+        if constexpr (sizeof(Cell) == 1)
+        {
+            if (stride == 1)
+            {
+                const void* found = memrchr(mem + begin, value, pos + 1 - begin);
+                return (found) ? (const Cell*)found - mem : begin - 1;
+            }
+        }
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+        const int32_t cell = sizeof(Cell);
+        const int32_t lanes = vector_size / cell;
+        if (stride < lanes)
+        {
+            // o último bit da máscara corresponde ao byte mais alto de 'pos',
+            // o byte mais alto de 'pos - stride' fica 'stride * cell' bits abaixo...
+            uint32_t mask = 0, step = 0;
+            for (int32_t i = 0; i < lanes; i += stride, step += stride)
+                mask |= 1u << (vector_size - 1 - i * cell);
+
+            for (; pos - (lanes - 1) >= begin; pos -= step)
+            {
+                uint32_t hits = VirtualMachine::compare(mem + pos - (lanes - 1), value) & mask;
+                if (hits)
+                    return pos - (__builtin_clz(hits) - (32 - vector_size)) / cell;
+            }
+        }
+#endif
+
+        for (; pos >= begin; pos -= stride)
+        {
+            if (mem[pos] == value)
+                return pos;
+        }
+        return pos;
     }
 
     template <typename T>
-    T read_program()
+    static inline T decode(const uint8_t* program, uint32_t& bi)
     {
         static_assert(std::is_integral<T>::value);
 
         T res = 0;
         for (uint8_t i = sizeof(T); i; i--)
-            res |= this->program[this->pc++] << ((i - 1) * 8);
+            res |= (T)program[bi++] << ((i - 1) * 8);
         return res;
 
         // uma alternativa mais curta seria:
-        //      return *((T*)(this->program + this->pc));
+        //      return *((T*)(program + bi));
         //
         // mas além de ser mais feio e gambiarrento, 
         // o código gerado tem o dobro de instruções
@@ -159,7 +1437,7 @@ struct VirtualMachine
         } 
     }
 
-    uint8_t read_num()
+    Cell read_num()
     {
         init:;
         if (this->bstdin.length() > 0)
@@ -168,7 +1446,7 @@ struct VirtualMachine
                 panic("value received by READ_NUM is not a number");
 
             size_t end;
-            uint8_t number = std::stoul(this->bstdin, &end);
+            Cell number = std::stoul(this->bstdin, &end);
             this->bstdin.erase(0, end);
             return number;
         }
@@ -179,9 +1457,107 @@ struct VirtualMachine
         }
     }
 
+    // executa o início do programa com a fita fixa até a primeira leitura, o END ou
+    // 'budget' instruções, para que 'snapshot' grave o estado alcançado
+    void pre_execute(uint64_t budget)
+    {
+        if (this->code.empty())
+            this->load();
+        this->run_switch<FixedTape, true>(budget);
+    }
+
+    // estado da VM no formato de 'BinaryFlags::SNAPSHOT': índice da instrução (uint32),
+    // 'mp' (uint16, posição relativa à origem como em ASSIGN_MP), a saída pendente
+    // (uint32 bytes já escritos, uint32 tamanho, bytes) e o trecho da fita que contém
+    // as células diferentes de 0 (int16 primeira posição, uint32 quantidade, células)
+    std::vector<uint8_t> snapshot() const
+    {
+        std::vector<uint8_t> out;
+
+        auto put = [&](auto value)
+        {
+            for (uint8_t i = sizeof(value); i; i--)
+                out.push_back(value >> ((i - 1) * 8));
+        };
+
+        int32_t first = INT16_MAX + 1;
+        int32_t last = INT16_MIN - 1;
+        for (int32_t position = INT16_MIN; position <= INT16_MAX; position++)
+        {
+            if (this->mem[(uint16_t)position] != 0)
+            {
+                first = std::min(first, position);
+                last = position;
+            }
+        }
+        if (last < first)
+            first = last = 0;
+        else
+            last++;
+
+        put((uint32_t)this->pc);
+        put((uint16_t)this->mp);
+        put((uint32_t)this->flushed);
+        put((uint32_t)this->bstdout.size());
+        out.insert(out.end(), this->bstdout.begin(), this->bstdout.end());
+        put((int16_t)first);
+        put((uint32_t)(last - first));
+        for (int32_t position = first; position < last; position++)
+            put(this->mem[(uint16_t)position]);
+
+        return out;
+    }
+
+    // lê um snapshot do início de 'data' e retorna o seu tamanho em bytes; a saída
+    // já escrita durante 'pre_execute' é escrita agora e o resto fica pendente
+    uint32_t restore(const uint8_t* data, uint32_t size)
+    {
+        uint32_t bi = 0;
+
+        auto need = [&](uint64_t bytes)
+        {
+            if (bi + bytes > size)
+                panic("truncated snapshot");
+        };
+
+        need(14);
+        this->start_pc = VirtualMachine::decode<uint32_t>(data, bi);
+        int16_t mp = VirtualMachine::decode<int16_t>(data, bi);
+        uint32_t flushed = VirtualMachine::decode<uint32_t>(data, bi);
+        uint32_t output = VirtualMachine::decode<uint32_t>(data, bi);
+
+        need((uint64_t)output + 6);
+        if (flushed > output)
+            panic("truncated snapshot");
+        std::cout.write((const char*)data + bi, flushed) << std::flush;
+        this->bstdout.assign((const char*)data + bi + flushed, output - flushed);
+        bi += output;
+
+        int16_t first = VirtualMachine::decode<int16_t>(data, bi);
+        uint32_t count = VirtualMachine::decode<uint32_t>(data, bi);
+
+        need((uint64_t)count * sizeof(Cell));
+        if (first + (int64_t)count > INT16_MAX + 1)
+            panic("truncated snapshot");
+
+        bool growable = this->tape_mode == TapeMode::GROWABLE;
+        for (int32_t position = first; position < first + (int64_t)count; position++)
+        {
+            Cell value = VirtualMachine::decode<Cell>(data, bi);
+            this->mem[(growable) ? GrowableTape::assign(position) : FixedTape::assign((uint16_t)position)] = value;
+        }
+
+        this->mp = (growable) ? GrowableTape::assign(mp) : FixedTape::assign((uint16_t)mp);
+        this->code.clear();
+        return bi;
+    }
+
     void clear_memory()
     {
-        memset(this->mem, 0, this->mem_size);
+        if (this->tape_mode == TapeMode::GROWABLE)
+            GrowableTape::clear();
+        else
+            memset(this->mem, 0, FixedTape::size * sizeof(Cell));
     }
     
     void push_back_program(const uint8_t* new_part, uint32_t np_size)
@@ -196,6 +1572,7 @@ struct VirtualMachine
 
         this->program_size += np_size;
         this->program = np;
+        this->code.clear();
     }
 };
 
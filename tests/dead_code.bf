@@ -0,0 +1,5 @@
+// loop de comentário no início, loop depois de ']' e código sem efeito no fim
+[+++.>-<]
++3[-][+.>+<]
+>+2.>+5<<+.
+>>+7>>+9<<[-]
@@ -0,0 +1,2 @@
+// um 'f' do código entre dois prints não pode sumir em 'merge_prints'
++72.a f +29.a
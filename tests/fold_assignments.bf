@@ -0,0 +1,3 @@
+// somas logo antes de uma atribuição são sobrescritas; depois do SCAN a fita é desconhecida
++4>+5>+6[<]>
++7[-]+2.>+5<+4[-]>.
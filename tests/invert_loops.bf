@@ -0,0 +1,6 @@
+// loops usados como if ('[ ... [-]]'), ']]' encadeados e um '[' interno que salta para o
+// de fora; depois do SCAN a posição do ponteiro, e com ela toda a fita, é desconhecida
++4>+5>+6[<]>
+[.>+<[-]]>.
+[[.[-]]]
+>[>+2.<[-]]>.
@@ -0,0 +1,2 @@
+// prints de células conhecidas viram um texto só, mas os FLUSHes do código ficam
++72.a+29.a+7.a.a+3.a f >+44.a f +12.a
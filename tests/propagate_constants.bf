@@ -0,0 +1,4 @@
+// valores conhecidos desde a fita zerada, inclusive depois de loops balanceados
++5>+3<[->+<]>.
+>+10[-<+>]<.
+>>+2[>+3<-]<<[>>>+<<<-]>>>.
@@ -0,0 +1,2 @@
+// a pré-execução para na primeira leitura, o resto depende da entrada
++65.a f ,[>+2<-]>. f ,a.a f
@@ -0,0 +1,50 @@
+# roda 'PROGRAM' na VM ('run -c --dispatch=switch') e no modo 'MODE', falha se as saídas diferem
+#   MAIN: o executável, WORK: prefixo dos arquivos gerados, ARGS: opções de compilação (lista)
+#   INPUT: arquivo lido como entrada, EXPECTED: se definido, a saída que a VM tem que dar
+#   MODE: 'jit' e 'tiered' rodam com '--jit' e '--tiered', 'c' compila o '--emit=c' com 'CC',
+#         'native' roda o executável do '--native' e 'pre' o binário do '--pre-execute'
+
+if (INPUT)
+    set(stdin INPUT_FILE ${INPUT})
+endif()
+
+function(run_checked output)
+    execute_process(COMMAND ${ARGN} ${stdin} OUTPUT_VARIABLE out RESULT_VARIABLE code)
+    if (NOT code EQUAL 0)
+        message(FATAL_ERROR "'${ARGN}' exited with ${code}:\n${out}")
+    endif()
+    set(${output} "${out}" PARENT_SCOPE)
+endfunction()
+
+# 'run -c' escreve "compiling" antes da saída do programa
+function(run_compiled output)
+    run_checked(out ${ARGN})
+    string(REGEX REPLACE "^[^\n]*compiling[^\n]*\n" "" out "${out}")
+    set(${output} "${out}" PARENT_SCOPE)
+endfunction()
+
+run_compiled(expected ${MAIN} run -c --dispatch=switch ${ARGS} ${PROGRAM})
+
+if (DEFINED EXPECTED AND NOT expected STREQUAL EXPECTED)
+    message(FATAL_ERROR "the VM printed\n[${expected}]\ninstead of\n[${EXPECTED}]")
+endif()
+
+if (MODE STREQUAL "jit" OR MODE STREQUAL "tiered")
+    run_compiled(actual ${MAIN} run -c --${MODE} ${ARGS} ${PROGRAM})
+elseif (MODE STREQUAL "c")
+    run_checked(ignored ${MAIN} build --emit=c ${ARGS} -o ${WORK}.c ${PROGRAM})
+    run_checked(ignored ${CC} -O1 -o ${WORK}_c ${WORK}.c)
+    run_checked(actual ${WORK}_c)
+elseif (MODE STREQUAL "native")
+    run_checked(ignored ${MAIN} build --native ${ARGS} -o ${WORK}_native ${PROGRAM})
+    run_checked(actual ${WORK}_native)
+elseif (MODE STREQUAL "pre")
+    run_checked(ignored ${MAIN} build --pre-execute ${ARGS} -o ${WORK}.brfk ${PROGRAM})
+    run_checked(actual ${MAIN} run ${WORK}.brfk)
+else()
+    message(FATAL_ERROR "unknown mode '${MODE}'")
+endif()
+
+if (NOT actual STREQUAL expected)
+    message(FATAL_ERROR "'${MODE}' printed\n[${actual}]\nbut the VM printed\n[${expected}]")
+endif()
@@ -0,0 +1,4 @@
+// SCANs nos dois sentidos e MUL_ADDs com vários alvos
++>+>+>>+<<<<[>]>.
++[<]>.
+>+6[>+2>+3<<-]>.>.
@@ -0,0 +1,5 @@
+// movimentos do ponteiro afundados em offsets, com SCANs e MUL_ADDs no meio
+>+>++>+++<<.>.>.
+<<<+>>>>>+<<[>]>.
++4[<<+3>>-]<<.
+>>>>+7<+2<-1.>.>.
@@ -0,0 +1,4 @@
+// contadores conhecidos na entrada: os loops internos são desenrolados
++8[>+4<-]>.
+>+3[>+3[>+2<-]<-]>>.
+>+5[>+.<-]>.